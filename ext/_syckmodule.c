@@ -2,6 +2,13 @@
 #include <Python.h>
 #include <syck.h>
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef MS_WINDOWS
+#include <io.h>
+#endif
+
 /****************************************************************************
  * Python 2.2 compatibility.
  ****************************************************************************/
@@ -16,6 +23,44 @@
 #define PyMODINIT_FUNC  void
 #endif
 
+/****************************************************************************
+ * Python 2.4 compatibility.
+ ****************************************************************************/
+
+#if PY_VERSION_HEX < 0x02050000 && !defined(PY_SSIZE_T_MIN)
+typedef int Py_ssize_t;
+#define PY_SSIZE_T_MAX INT_MAX
+#define PY_SSIZE_T_MIN INT_MIN
+#endif
+
+/****************************************************************************
+ * Python 2.3 compatibility: the datetime C API appeared in Python 2.4.
+ ****************************************************************************/
+
+#if PY_VERSION_HEX >= 0x02040000
+#include <datetime.h>
+#define PYSYCK_HAVE_DATETIME
+#endif
+
+/****************************************************************************
+ * Python 2.5 compatibility: the new buffer interface appeared in Python 2.6.
+ * An object exporting a Py_buffer cannot be resized while the view is held;
+ * a pointer returned by the old interface may be freed by any Python code.
+ ****************************************************************************/
+
+#if PY_VERSION_HEX >= 0x02060000
+#define PYSYCK_HAVE_BUFFER_VIEW
+#endif
+
+/****************************************************************************
+ * Python 2.6 compatibility: _PyObject_GC_IS_TRACKED appeared in Python 2.7.
+ ****************************************************************************/
+
+#ifndef _PyObject_GC_IS_TRACKED
+#define _PyObject_GC_IS_TRACKED(o) \
+    (_Py_AS_GC(o)->gc.gc_refs != _PyGC_REFS_UNTRACKED)
+#endif
+
 /****************************************************************************
  * Global objects: _syck.error, 'scalar', 'seq', 'map',
  * '1quote', '2quote', 'fold', 'literal', 'plain', '+', '-'.
@@ -69,7 +114,7 @@ PySyckNode_clear(PySyckNodeObject *self)
     Py_XDECREF(tmp);
 
     tmp = self->anchor;
-    self->value = NULL;
+    self->anchor = NULL;
     Py_XDECREF(tmp);
 
     return 0;
@@ -95,10 +140,74 @@ PySyckNode_traverse(PySyckNodeObject *self, visitproc visit, void *arg)
     return 0;
 }
 
+/* Freelists of Scalar, Seq, and Map objects. A free node keeps its memory
+ * and its GC header; its 'value' field points to the next free node. Only
+ * the exact types use freelists, subclasses are allocated as usual. */
+
+#define PYSYCK_MAXFREELIST  1024
+
+typedef struct {
+    PySyckNodeObject *head;
+    int length;
+} PySyckFreeList;
+
+static PySyckFreeList PySyckScalar_FreeList = {NULL, 0};
+static PySyckFreeList PySyckSeq_FreeList = {NULL, 0};
+static PySyckFreeList PySyckMap_FreeList = {NULL, 0};
+
+static PyTypeObject PySyckScalar_Type;
+static PyTypeObject PySyckSeq_Type;
+static PyTypeObject PySyckMap_Type;
+
+static PySyckFreeList *
+PySyckNode_freelist(PyTypeObject *type)
+{
+    if (type == &PySyckScalar_Type)
+        return &PySyckScalar_FreeList;
+    if (type == &PySyckSeq_Type)
+        return &PySyckSeq_FreeList;
+    if (type == &PySyckMap_Type)
+        return &PySyckMap_FreeList;
+    return NULL;
+}
+
+/* Allocates a node. 'value', 'tag', and 'anchor' are set to NULL; the
+ * caller initializes the type-specific fields. */
+
+static PySyckNodeObject *
+PySyckNode_alloc(PyTypeObject *type)
+{
+    PySyckFreeList *freelist = PySyckNode_freelist(type);
+    PySyckNodeObject *self;
+
+    if (freelist && freelist->head) {
+        self = freelist->head;
+        freelist->head = (PySyckNodeObject *)self->value;
+        freelist->length--;
+        self->value = NULL;
+        _Py_NewReference((PyObject *)self);
+        PyObject_GC_Track(self);
+        return self;
+    }
+
+    return (PySyckNodeObject *)type->tp_alloc(type, 0);
+}
+
 static void
 PySyckNode_dealloc(PySyckNodeObject *self)
 {
+    PySyckFreeList *freelist = PySyckNode_freelist(self->ob_type);
+
+    PyObject_GC_UnTrack(self);
     PySyckNode_clear(self);
+
+    if (freelist && freelist->length < PYSYCK_MAXFREELIST) {
+        self->value = (PyObject *)freelist->head;
+        freelist->head = self;
+        freelist->length++;
+        return;
+    }
+
     self->ob_type->tp_free((PyObject *)self);
 }
 
@@ -124,6 +233,17 @@ PySyckNode_gettag(PySyckNodeObject *self, void *closure)
     return value;
 }
 
+/* The parser does not track the scalars it builds, since they refer only to
+ * strings. An instance of a str subclass may refer to other objects, so a
+ * node that stores one is tracked again. */
+
+static void
+PySyckNode_track_string(PySyckNodeObject *self, PyObject *value)
+{
+    if (!PyString_CheckExact(value) && !_PyObject_GC_IS_TRACKED(self))
+        PyObject_GC_Track(self);
+}
+
 static int
 PySyckNode_settag(PySyckNodeObject *self, PyObject *value, void *closure)
 {
@@ -143,6 +263,7 @@ PySyckNode_settag(PySyckNodeObject *self, PyObject *value, void *closure)
         return -1;
     }
 
+    PySyckNode_track_string(self, value);
     Py_XDECREF(self->tag);
     Py_INCREF(value);
     self->tag = value;
@@ -177,6 +298,7 @@ PySyckNode_setanchor(PySyckNodeObject *self, PyObject *value, void *closure)
         return -1;
     }
 
+    PySyckNode_track_string(self, value);
     Py_XDECREF(self->anchor);
     Py_INCREF(value);
     self->anchor = value;
@@ -234,20 +356,20 @@ typedef struct {
     char chomp;
 } PySyckScalarObject;
 
+/* Creates a scalar node holding 'value'; steals the reference. */
+
 static PyObject *
-PySyckScalar_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+PySyckScalar_create(PyTypeObject *type, PyObject *value)
 {
     PySyckScalarObject *self;
 
-    self = (PySyckScalarObject *)type->tp_alloc(type, 0);
-    if (!self) return NULL;
-
-    self->value = PyString_FromString("");
-    if (!self->value) {
-        Py_DECREF(self);
+    self = (PySyckScalarObject *)PySyckNode_alloc(type);
+    if (!self) {
+        Py_DECREF(value);
         return NULL;
     }
 
+    self->value = value;
     self->tag = NULL;
     self->anchor = NULL;
     self->style = scalar_none;
@@ -258,6 +380,17 @@ PySyckScalar_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return (PyObject *)self;
 }
 
+static PyObject *
+PySyckScalar_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *value;
+
+    value = PyString_FromString("");
+    if (!value) return NULL;
+
+    return PySyckScalar_create(type, value);
+}
+
 static int
 PySyckScalar_setvalue(PySyckScalarObject *self, PyObject *value, void *closure)
 {
@@ -270,6 +403,7 @@ PySyckScalar_setvalue(PySyckScalarObject *self, PyObject *value, void *closure)
         return -1;
     }
 
+    PySyckNode_track_string((PySyckNodeObject *)self, value);
     Py_DECREF(self->value);
     Py_INCREF(value);
     self->value = value;
@@ -560,20 +694,20 @@ typedef struct {
     enum seq_style style;
 } PySyckSeqObject;
 
+/* Creates a sequence node holding 'value'; steals the reference. */
+
 static PyObject *
-PySyckSeq_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+PySyckSeq_create(PyTypeObject *type, PyObject *value)
 {
     PySyckSeqObject *self;
 
-    self = (PySyckSeqObject *)type->tp_alloc(type, 0);
-    if (!self) return NULL;
-
-    self->value = PyList_New(0);
-    if (!self->value) {
-        Py_DECREF(self);
+    self = (PySyckSeqObject *)PySyckNode_alloc(type);
+    if (!self) {
+        Py_DECREF(value);
         return NULL;
     }
 
+    self->value = value;
     self->tag = NULL;
     self->anchor = NULL;
     self->style = seq_none;
@@ -581,6 +715,17 @@ PySyckSeq_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return (PyObject *)self;
 }
 
+static PyObject *
+PySyckSeq_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *value;
+
+    value = PyList_New(0);
+    if (!value) return NULL;
+
+    return PySyckSeq_create(type, value);
+}
+
 static int
 PySyckSeq_setvalue(PySyckSeqObject *self, PyObject *value, void *closure)
 {
@@ -731,20 +876,20 @@ typedef struct {
     enum map_style style;
 } PySyckMapObject;
 
+/* Creates a mapping node holding 'value'; steals the reference. */
+
 static PyObject *
-PySyckMap_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+PySyckMap_create(PyTypeObject *type, PyObject *value)
 {
     PySyckMapObject *self;
 
-    self = (PySyckMapObject *)type->tp_alloc(type, 0);
-    if (!self) return NULL;
-
-    self->value = PyDict_New();
-    if (!self->value) {
-        Py_DECREF(self);
+    self = (PySyckMapObject *)PySyckNode_alloc(type);
+    if (!self) {
+        Py_DECREF(value);
         return NULL;
     }
 
+    self->value = value;
     self->tag = NULL;
     self->anchor = NULL;
     self->style = seq_none;
@@ -752,6 +897,17 @@ PySyckMap_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return (PyObject *)self;
 }
 
+static PyObject *
+PySyckMap_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *value;
+
+    value = PyDict_New();
+    if (!value) return NULL;
+
+    return PySyckMap_create(type, value);
+}
+
 static int
 PySyckMap_setvalue(PySyckMapObject *self, PyObject *value, void *closure)
 {
@@ -885,872 +1041,3696 @@ static PyTypeObject PySyckMap_Type = {
 };
 
 /****************************************************************************
- * The type _syck.Parser.
+ * Core YAML types constructed by Parser.load_native().
  ****************************************************************************/
 
-PyDoc_STRVAR(PySyckParser_doc,
-    "Parser(source, implicit_typing=True, taguri_expansion=True)\n"
-    "      -> a Parser object\n\n"
-    "_syck.Parser is a low-lever wrapper of the Syck parser. It parses\n"
-    "a YAML stream and produces a tree of Nodes.\n");
+#define PYSYCK_TAGURI_PREFIX    "tag:yaml.org,2002:"
+
+enum {
+    PYSYCK_NULL,
+    PYSYCK_BOOL_YES,
+    PYSYCK_BOOL_NO,
+    PYSYCK_STR,
+    PYSYCK_INT,
+    PYSYCK_INT_HEX,
+    PYSYCK_INT_OCT,
+    PYSYCK_INT_BASE60,
+    PYSYCK_FLOAT,
+    PYSYCK_FLOAT_FIX,
+    PYSYCK_FLOAT_EXP,
+    PYSYCK_FLOAT_BASE60,
+    PYSYCK_FLOAT_INF,
+    PYSYCK_FLOAT_NEGINF,
+    PYSYCK_FLOAT_NAN,
+    PYSYCK_TIMESTAMP,
+    PYSYCK_TIMESTAMP_YMD,
+    PYSYCK_TIMESTAMP_ISO8601,
+    PYSYCK_TIMESTAMP_SPACED,
+    PYSYCK_SEQ,
+    PYSYCK_MAP,
+    PYSYCK_CORE_TYPES,      /* the number of core types */
+    PYSYCK_OTHER = -1       /* not a core type, use Loader.construct() */
+};
 
 typedef struct {
-    PyObject_HEAD
-    /* Attributes: */
-    PyObject *source;       /* a string or file-like object */
-    int implicit_typing;
-    int taguri_expansion;
-    /* Internal fields: */
-    PyObject *symbols;      /* symbol table, a list, NULL outside parse() */
-    SyckParser *parser;
-    int parsing;
-    int halt;
-} PySyckParserObject;
+    char *type_id;          /* the tag without the 'tag:yaml.org,2002:' prefix */
+    char *name;             /* the Loader constructor is 'construct_'+name */
+    enum syck_kind_tag kind;
+} PySyckCoreType;
+
+static PySyckCoreType PySyck_CoreTypes[PYSYCK_CORE_TYPES] = {
+    {"null", "null", syck_str_kind},
+    {"bool#yes", "bool_yes", syck_str_kind},
+    {"bool#no", "bool_no", syck_str_kind},
+    {"str", "str", syck_str_kind},
+    {"int", "int", syck_str_kind},
+    {"int#hex", "int_hex", syck_str_kind},
+    {"int#oct", "int_oct", syck_str_kind},
+    {"int#base60", "int_base60", syck_str_kind},
+    {"float", "float", syck_str_kind},
+    {"float#fix", "float_fix", syck_str_kind},
+    {"float#exp", "float_exp", syck_str_kind},
+    {"float#base60", "float_base60", syck_str_kind},
+    {"float#inf", "float_inf", syck_str_kind},
+    {"float#neginf", "float_neginf", syck_str_kind},
+    {"float#nan", "float_nan", syck_str_kind},
+    {"timestamp", "timestamp", syck_str_kind},
+    {"timestamp#ymd", "timestamp_ymd", syck_str_kind},
+    {"timestamp#iso8601", "timestamp_iso8601", syck_str_kind},
+    {"timestamp#spaced", "timestamp_spaced", syck_str_kind},
+    {"seq", "seq", syck_seq_kind},
+    {"map", "map", syck_map_kind},
+};
 
-static PyObject *
-PySyckParser_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
-{
-    PySyckParserObject *self;
+#define PYSYCK_ALL_CORE_TYPES   ((1L << PYSYCK_CORE_TYPES) - 1)
 
-    self = (PySyckParserObject *)type->tp_alloc(type, 0);
-    if (!self) return NULL;
+static double PySyck_InfValue;
+static double PySyck_NaNValue;
 
-    self->source = NULL;
-    self->implicit_typing = 0;
-    self->taguri_expansion = 0;
-    self->symbols = NULL;
-    self->parser = NULL;
-    self->parsing = 0;
-    self->halt = 1;
+static int
+PySyck_find_core_type(char *type_id)
+{
+    int k;
+    size_t prefix_len = sizeof(PYSYCK_TAGURI_PREFIX)-1;
 
-    /*
-    self->symbols = PyList_New(0);
-    if (!self->symbols) {
-        Py_DECREF(self);
-        return NULL;
-    }
-    */
+    if (strncmp(type_id, PYSYCK_TAGURI_PREFIX, prefix_len) == 0)
+        type_id += prefix_len;
 
-    return (PyObject *)self;
+    for (k = 0; k < PYSYCK_CORE_TYPES; k++)
+        if (strcmp(type_id, PySyck_CoreTypes[k].type_id) == 0)
+            return k;
+
+    return PYSYCK_OTHER;
 }
 
-static int
-PySyckParser_clear(PySyckParserObject *self)
+static long
+PySyck_core_types_mask(PyObject *names)
 {
-    PyObject *tmp;
+    PyObject *iterator, *name;
+    long mask = 0;
+    char *str;
+    int k;
 
-    if (self->parser) {
-        syck_free_parser(self->parser);
-        self->parser = NULL;
-    }
+    if (!names || names == Py_None)
+        return PYSYCK_ALL_CORE_TYPES;
 
-    tmp = self->source;
-    self->source = NULL;
-    Py_XDECREF(tmp);
+    iterator = PyObject_GetIter(names);
+    if (!iterator) return -1;
 
-    tmp = self->symbols;
-    self->symbols = NULL;
-    Py_XDECREF(tmp);
+    while ((name = PyIter_Next(iterator))) {
+        if (!PyString_Check(name)) {
+            PyErr_SetString(PyExc_TypeError, "type names must be strings");
+            Py_DECREF(name);
+            Py_DECREF(iterator);
+            return -1;
+        }
+        str = PyString_AS_STRING(name);
+        for (k = 0; k < PYSYCK_CORE_TYPES; k++)
+            if (strcmp(str, PySyck_CoreTypes[k].name) == 0)
+                mask |= 1L << k;
+        Py_DECREF(name);
+    }
 
-    return 0;
+    Py_DECREF(iterator);
+    if (PyErr_Occurred()) return -1;
+
+    return mask;
 }
 
+/* The high bits of all bytes of a word. */
+
+#define PYSYCK_HIGH_BITS    ((unsigned long)-1 / 0xFF * 0x80)
+
 static int
-PySyckParser_traverse(PySyckParserObject *self, visitproc visit, void *arg)
+PySyck_is_ascii(const char *str, Py_ssize_t len)
 {
-    int ret;
+    const char *end = str+len;
+    const unsigned long *word;
 
-    if (self->source)
-        if ((ret = visit(self->source, arg)) != 0)
-            return ret;
+    /* Check the bytes up to a word boundary, then a word at a time. */
+    for (; str < end && ((size_t)str & (sizeof(unsigned long)-1)); str++)
+        if (*str & 0x80)
+            return 0;
 
-    if (self->symbols)
-        if ((ret = visit(self->symbols, arg)) != 0)
-            return ret;
+    for (word = (const unsigned long *)str;
+            (const char *)(word+1) <= end; word++)
+        if (*word & PYSYCK_HIGH_BITS)
+            return 0;
 
-    return 0;
+    for (str = (const char *)word; str < end; str++)
+        if (*str & 0x80)
+            return 0;
+
+    return 1;
 }
 
-static void
-PySyckParser_dealloc(PySyckParserObject *self)
+/* Returns the string itself if it is ASCII, or decodes it from UTF-8. */
+
+static PyObject *
+PySyck_decode_str(PyObject *value)
 {
-    PySyckParser_clear(self);
-    self->ob_type->tp_free((PyObject *)self);
+    char *str = PyString_AS_STRING(value);
+    Py_ssize_t len = PyString_GET_SIZE(value);
+
+    if (PySyck_is_ascii(str, len)) {
+        Py_INCREF(value);
+        return value;
+    }
+    return PyUnicode_DecodeUTF8(str, len, "strict");
 }
 
-static PyObject *
-PySyckParser_getsource(PySyckParserObject *self, void *closure)
+/* Parses an integer that fits in a C long. Accepts an optional sign and, in
+ * base 16, the '0x' prefix, like int(). Returns 0 if the value is not such
+ * an integer. */
+
+static int
+PySyck_parse_long(const char *str, Py_ssize_t len, int base, long *result)
 {
-    PyObject *value = self->source ? self->source : Py_None;
+    const char *end = str+len;
+    unsigned long value = 0, limit;
+    int negative = 0;
+    int digit;
+
+    if (str < end && (*str == '-' || *str == '+'))
+        negative = (*str++ == '-');
+    if (base == 16 && end-str > 2 && str[0] == '0'
+            && (str[1] == 'x' || str[1] == 'X'))
+        str += 2;
+    if (str == end)
+        return 0;
 
-    Py_INCREF(value);
-    return value;
+    limit = negative ? (unsigned long)LONG_MAX+1 : (unsigned long)LONG_MAX;
+    for (; str < end; str++) {
+        if (*str >= '0' && *str <= '9')
+            digit = *str-'0';
+        else if (*str >= 'a' && *str <= 'f')
+            digit = *str-'a'+10;
+        else if (*str >= 'A' && *str <= 'F')
+            digit = *str-'A'+10;
+        else
+            return 0;
+        if (digit >= base || value > (limit-digit)/base)
+            return 0;
+        value = value*base+digit;
+    }
+
+    if (negative)
+        *result = value ? -(long)(value-1)-1 : 0;
+    else
+        *result = (long)value;
+    return 1;
 }
 
-static PyObject *
-PySyckParser_getimplicit_typing(PySyckParserObject *self, void *closure)
+/* Parses a sexagesimal integer like '1:30:00'. The parts are summed from
+ * the last one, as Loader.construct_numeric_base60() does. Returns 0 if the
+ * value does not fit in a C long. */
+
+static int
+PySyck_parse_base60(const char *str, Py_ssize_t len, long *result)
 {
-    PyObject *value = self->implicit_typing ? Py_True : Py_False;
+    const char *end = str+len;
+    const char *part;
+    long value = 0, base = 1, digit;
+
+    while (1) {
+        for (part = end; part > str && part[-1] != ':'; part--);
+        if (!PySyck_parse_long(part, end-part, 10, &digit)
+                || digit == LONG_MIN)
+            return 0;
+        if (digit && (base > LONG_MAX/(digit < 0 ? -digit : digit)))
+            return 0;
+        digit *= base;
+        if ((digit > 0 && value > LONG_MAX-digit)
+                || (digit < 0 && value < LONG_MIN-digit))
+            return 0;
+        value += digit;
+        if (part == str)
+            break;
+        end = part-1;
+        if (base > LONG_MAX/60)
+            return 0;
+        base *= 60;
+    }
 
-    Py_INCREF(value);
-    return value;
+    *result = value;
+    return 1;
 }
 
+/* Parses a sexagesimal float like '1:30.5' with float() for each part. */
+
 static PyObject *
-PySyckParser_gettaguri_expansion(PySyckParserObject *self, void *closure)
+PySyck_construct_float_base60(const char *str, Py_ssize_t len)
 {
-    PyObject *value = self->taguri_expansion ? Py_True : Py_False;
+    const char *end = str+len;
+    const char *part;
+    PyObject *string, *number;
+    double value = 0.0, base = 1.0, digit;
+
+    while (1) {
+        for (part = end; part > str && part[-1] != ':'; part--);
+        string = PyString_FromStringAndSize(part, end-part);
+        if (!string) return NULL;
+        number = PyFloat_FromString(string, NULL);
+        Py_DECREF(string);
+        if (!number) return NULL;
+        digit = PyFloat_AS_DOUBLE(number);
+        Py_DECREF(number);
+        value += digit*base;
+        if (part == str)
+            break;
+        end = part-1;
+        base *= 60.0;
+    }
 
-    Py_INCREF(value);
-    return value;
+    return PyFloat_FromDouble(value);
 }
 
-static PyObject *
-PySyckParser_geteof(PySyckParserObject *self, void *closure)
+#define PYSYCK_IS_TIMESTAMP(type) \
+    ((type) >= PYSYCK_TIMESTAMP && (type) <= PYSYCK_TIMESTAMP_SPACED)
+
+/* Parses exactly 'count' decimal digits. *result is set only on success. */
+
+static int
+PySyck_parse_digits(const char *str, const char *end, int count, int *result)
 {
-    PyObject *value = self->halt ? Py_True : Py_False;
+    int value = 0;
+    int k;
 
-    Py_INCREF(value);
-    return value;
+    if (end-str < count)
+        return 0;
+    for (k = 0; k < count; k++) {
+        if (str[k] < '0' || str[k] > '9')
+            return 0;
+        value = value*10 + (str[k]-'0');
+    }
+    *result = value;
+    return 1;
 }
 
-static PyGetSetDef PySyckParser_getsetters[] = {
-    {"source", (getter)PySyckParser_getsource, NULL,
-        PyDoc_STR("IO source, a string or a file-like object"), NULL},
-    {"implicit_typing", (getter)PySyckParser_getimplicit_typing, NULL,
-        PyDoc_STR("implicit typing of builtin YAML types"), NULL},
-    {"taguri_expansion", (getter)PySyckParser_gettaguri_expansion, NULL,
-        PyDoc_STR("expansion of types in full taguri"), NULL},
-    {"eof", (getter)PySyckParser_geteof, NULL,
-        PyDoc_STR("EOF flag"), NULL},
-    {NULL}  /* Sentinel */
-};
+/* Converts a timestamp like Loader.construct_timestamp() does with the
+ * regular expression Loader.timestamp_expr: a date, optionally followed by
+ * a time, a fraction and a time zone, which is subtracted from the time.
+ * Returns 1 and sets *result if the value is converted, 0 if it must be
+ * passed to Loader.construct(), and -1 on error. */
 
-static SYMID
-PySyckParser_node_handler(SyckParser *parser, SyckNode *node)
+static int
+PySyck_construct_timestamp(const char *str, Py_ssize_t len, PyObject **result)
 {
-    PyGILState_STATE gs;
+#ifdef PYSYCK_HAVE_DATETIME
+    const char *end = str+len;
+    const char *ptr, *start;
+    int year, month, day;
+    int hour = 0, minute = 0, second = 0, micro = 0;
+    int zhour = 0, zminute = 0;
+    int digits;
+    PyObject *stamp, *diff;
+
+    if (!PyDateTimeAPI)
+        return 0;
 
-    PySyckParserObject *self = (PySyckParserObject *)parser->bonus;
+    if (!PySyck_parse_digits(str, end, 4, &year) || end-str < 10
+            || str[4] != '-' || !PySyck_parse_digits(str+5, end, 2, &month)
+            || str[7] != '-' || !PySyck_parse_digits(str+8, end, 2, &day))
+        return 0;
 
-    SYMID index;
-    PySyckNodeObject *object = NULL;
+    /* The time is optional: if it does not match, the rest is ignored. */
+    ptr = str+10;
+    if (ptr < end && (*ptr == 'T' || *ptr == 't'))
+        ptr++;
+    else {
+        start = ptr;
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+            ptr++;
+        if (ptr == start)
+            ptr = end;
+    }
+    if (end-ptr >= 8 && PySyck_parse_digits(ptr, end, 2, &hour)
+            && ptr[2] == ':' && PySyck_parse_digits(ptr+3, end, 2, &minute)
+            && ptr[5] == ':' && PySyck_parse_digits(ptr+6, end, 2, &second)) {
+        ptr += 8;
+        if (ptr < end && *ptr == '.') {
+            for (ptr++, digits = 0; ptr < end && *ptr >= '0' && *ptr <= '9';
+                    ptr++, digits++) {
+                if (digits == 9)
+                    return 0;
+                micro = micro*10 + (*ptr-'0');
+            }
+        }
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+            ptr++;
+        if (ptr < end && (*ptr == '+' || *ptr == '-')
+                && PySyck_parse_digits(ptr+1, end, 2, &zhour)) {
+            if (*ptr == '-')
+                zhour = -zhour;
+            ptr += 3;
+            if (ptr < end && *ptr == ':')
+                PySyck_parse_digits(ptr+1, end, 2, &zminute);
+        }
+    }
+    else {
+        hour = minute = second = 0;
+    }
 
-    PyObject *key, *value;
-    int k;
+    stamp = PyDateTime_FromDateAndTime(year, month, day,
+            hour, minute, second, micro);
+    if (!stamp) return -1;
 
-    if (self->halt)
-        return -1;
+    if (zhour || zminute) {
+        diff = PyDelta_FromDSU(0, zhour*3600+zminute*60, 0);
+        if (!diff) {
+            Py_DECREF(stamp);
+            return -1;
+        }
+        *result = PyNumber_Subtract(stamp, diff);
+        Py_DECREF(stamp);
+        Py_DECREF(diff);
+        if (!*result) return -1;
+    }
+    else {
+        *result = stamp;
+    }
 
-    gs = PyGILState_Ensure();
+    return 1;
+#else
+    return 0;
+#endif
+}
 
-    switch (node->kind) {
+/* Converts a scalar of the given core type directly from the node data,
+ * without creating a string object first. Handles the constants and the
+ * integers that fit in a C long. Returns 1 and sets *result if the value
+ * is converted, 0 if it is not, and -1 on error. */
 
-        case syck_str_kind:
-            object = (PySyckNodeObject *)
-                PySyckScalar_new(&PySyckScalar_Type, NULL, NULL);
-            if (!object) goto error;
-            value = PyString_FromStringAndSize(node->data.str->ptr,
-                    node->data.str->len);
-            if (!value) goto error;
-            Py_DECREF(object->value);
-            object->value = value;
-            break;
+static int
+PySyck_construct_direct(int type, const char *str, Py_ssize_t len,
+        PyObject **result)
+{
+    long value;
+    int ret = 0;
 
-        case syck_seq_kind:
-            object = (PySyckNodeObject *)
-                PySyckSeq_new(&PySyckSeq_Type, NULL, NULL);
-            if (!object) goto error;
-            for (k = 0; k < node->data.list->idx; k++) {
-                index = syck_seq_read(node, k)-1;
-                value = PyList_GetItem(self->symbols, index);
-                if (!value) goto error;
-                if (PyList_Append(object->value, value) < 0)
-                    goto error;
-            }
+    switch (type) {
+
+        case PYSYCK_NULL:
+            Py_INCREF(Py_None);
+            *result = Py_None;
+            return 1;
+
+        case PYSYCK_BOOL_YES:
+            Py_INCREF(Py_True);
+            *result = Py_True;
+            return 1;
+
+        case PYSYCK_BOOL_NO:
+            Py_INCREF(Py_False);
+            *result = Py_False;
+            return 1;
+
+        case PYSYCK_INT:
+            ret = PySyck_parse_long(str, len, 10, &value);
             break;
 
-        case syck_map_kind:
-            object = (PySyckNodeObject *)
-                PySyckMap_new(&PySyckMap_Type, NULL, NULL);
-            if (!object) goto error;
-            for (k = 0; k < node->data.pairs->idx; k++)
-            {
-                index = syck_map_read(node, map_key, k)-1;
-                key = PyList_GetItem(self->symbols, index);
-                if (!key) goto error;
-                index = syck_map_read(node, map_value, k)-1;
-                value = PyList_GetItem(self->symbols, index);
-                if (!value) goto error;
-                if (PyDict_SetItem(object->value, key, value) < 0)
-                    goto error;
-            }
+        case PYSYCK_INT_HEX:
+            ret = PySyck_parse_long(str, len, 16, &value);
             break;
-    }
 
-    if (node->type_id) {
-        object->tag = PyString_FromString(node->type_id);
-        if (!object->tag) goto error;
-    }
+        case PYSYCK_INT_OCT:
+            ret = PySyck_parse_long(str, len, 8, &value);
+            break;
 
-    if (node->anchor) {
-        object->anchor = PyString_FromString(node->anchor);
-        if (!object->anchor) goto error;
-    }
+        case PYSYCK_INT_BASE60:
+            ret = PySyck_parse_base60(str, len, &value);
+            break;
 
-    if (PyList_Append(self->symbols, (PyObject *)object) < 0)
-        goto error;
+        case PYSYCK_FLOAT_INF:
+            *result = PyFloat_FromDouble(PySyck_InfValue);
+            return *result ? 1 : -1;
 
-    Py_DECREF(object);
+        case PYSYCK_FLOAT_NEGINF:
+            *result = PyFloat_FromDouble(-PySyck_InfValue);
+            return *result ? 1 : -1;
 
-    index = PyList_GET_SIZE(self->symbols);
-    PyGILState_Release(gs);
-    return index;
+        case PYSYCK_FLOAT_NAN:
+            *result = PyFloat_FromDouble(PySyck_NaNValue);
+            return *result ? 1 : -1;
+    }
 
-error:
-    Py_XDECREF(object);
-    PyGILState_Release(gs);
-    self->halt = 1;
-    return -1;
+    if (!ret)
+        return 0;
+
+    *result = PyInt_FromLong(value);
+    return *result ? 1 : -1;
 }
 
-static void
-PySyckParser_error_handler(SyckParser *parser, char *str)
+/* Converts the value of a scalar node of the given core type. Returns 1 and
+ * sets *result if the value is converted, 0 if the value must be passed to
+ * Loader.construct(), and -1 on error. PySyck_construct_direct() is tried
+ * first, so only strings and the slower cases are left here. */
+
+static int
+PySyck_construct_scalar(int type, PyObject *value, PyObject **result)
 {
-    PyGILState_STATE gs;
+    char *str = PyString_AS_STRING(value);
+    Py_ssize_t len = PyString_GET_SIZE(value);
+
+    switch (type) {
+
+        case PYSYCK_STR:
+            *result = PySyck_decode_str(value);
+            if (!*result) {
+                if (!PyErr_ExceptionMatches(PyExc_UnicodeDecodeError))
+                    return -1;
+                /* Let Loader.construct_str() issue the warning. */
+                PyErr_Clear();
+                return 0;
+            }
+            break;
 
-    PySyckParserObject *self = (PySyckParserObject *)parser->bonus;
-    PyObject *value;
+        case PYSYCK_INT:
+            *result = PyInt_FromString(str, NULL, 10);
+            break;
 
-    if (self->halt) return;
+        case PYSYCK_INT_HEX:
+            *result = PyInt_FromString(str, NULL, 16);
+            break;
 
-    gs = PyGILState_Ensure();
+        case PYSYCK_INT_OCT:
+            *result = PyInt_FromString(str, NULL, 8);
+            break;
 
-    self->halt = 1;
+        case PYSYCK_FLOAT:
+        case PYSYCK_FLOAT_FIX:
+        case PYSYCK_FLOAT_EXP:
+            *result = PyFloat_FromString(value, NULL);
+            break;
 
-    value = Py_BuildValue("(sii)", str,
-            parser->linect, parser->cursor - parser->lineptr);
-    if (value) {
-        PyErr_SetObject(PySyck_Error, value);
+        case PYSYCK_FLOAT_BASE60:
+            *result = PySyck_construct_float_base60(str, len);
+            break;
+
+        default:
+            return 0;
     }
 
-    PyGILState_Release(gs);
+    if (!*result) return -1;
+
+    return 1;
 }
 
-SyckNode *
-PySyckParser_bad_anchor_handler(SyckParser *parser, char *anchor)
+/* Checks whether a key could only be produced by the core constructors.
+ * Mappings with other keys (e.g. the merge key '<<') are passed to
+ * Loader.construct(). */
+
+static int
+PySyck_is_core_key(PyObject *key)
 {
-    PyGILState_STATE gs;
+    return (key == Py_None || PyString_CheckExact(key)
+            || PyUnicode_CheckExact(key) || PyInt_CheckExact(key)
+            || PyLong_CheckExact(key) || PyFloat_CheckExact(key)
+            || PyBool_Check(key));
+}
 
-    PySyckParserObject *self = (PySyckParserObject *)parser->bonus;
+/****************************************************************************
+ * Parser tree nodes.
+ ****************************************************************************/
 
-    if (!self->halt) {
-        gs = PyGILState_Ensure();
+/* A view of a node reported by Syck. In the deferred mode, the node handler
+ * copies the nodes into an array of PySyckTreeNode without calling the
+ * Python API, and the Python objects are built after syck_parse() returns. */
 
-        self->halt = 1;
-        PyErr_SetString(PyExc_TypeError, "recursive anchors are not implemented");
+typedef struct {
+    enum syck_kind_tag kind;
+    char *tag;              /* NULL if the node is untagged */
+    char *anchor;           /* NULL if the node is not anchored */
+    char *str;              /* the scalar value */
+    long length;            /* the length of str, or the number of children */
+    SYMID *items;           /* sequence items or mapping keys */
+    SYMID *values;          /* mapping values */
+} PySyckTreeNode;
 
-        PyGILState_Release(gs);
+static void
+PySyckTreeNode_view(PySyckTreeNode *view, SyckNode *node)
+{
+    view->kind = node->kind;
+    view->tag = node->type_id;
+    view->anchor = node->anchor;
+    view->str = NULL;
+    view->items = NULL;
+    view->values = NULL;
+
+    switch (node->kind) {
+        case syck_str_kind:
+            view->str = node->data.str->ptr;
+            view->length = node->data.str->len;
+            break;
+        case syck_seq_kind:
+            view->items = node->data.list->items;
+            view->length = node->data.list->idx;
+            break;
+        case syck_map_kind:
+            view->items = node->data.pairs->keys;
+            view->values = node->data.pairs->values;
+            view->length = node->data.pairs->idx;
+            break;
     }
+}
 
-    return syck_alloc_str();
+/* Copies the node. The value, the tag, and the anchor are stored in a single
+ * memory block, which starts at 'str' for scalars and at 'items' for
+ * collections. */
+
+static int
+PySyckTreeNode_copy(PySyckTreeNode *copy, SyckNode *node)
+{
+    size_t data_size, tag_size = 0, anchor_size = 0;
+    char *block;
+
+    PySyckTreeNode_view(copy, node);
+
+    if (copy->kind == syck_str_kind)
+        data_size = copy->length+1;
+    else if (copy->kind == syck_seq_kind)
+        data_size = copy->length*sizeof(SYMID);
+    else
+        data_size = 2*copy->length*sizeof(SYMID);
+    if (copy->tag)
+        tag_size = strlen(copy->tag)+1;
+    if (copy->anchor)
+        anchor_size = strlen(copy->anchor)+1;
+
+    block = malloc(data_size+tag_size+anchor_size+1);
+    if (!block) return -1;
+
+    if (copy->kind == syck_str_kind) {
+        memcpy(block, copy->str, copy->length);
+        block[copy->length] = '\0';
+        copy->str = block;
+    }
+    else {
+        memcpy(block, copy->items, copy->length*sizeof(SYMID));
+        if (copy->kind == syck_map_kind)
+            memcpy(block+copy->length*sizeof(SYMID), copy->values,
+                    copy->length*sizeof(SYMID));
+        copy->items = (SYMID *)block;
+        if (copy->kind == syck_map_kind)
+            copy->values = copy->items+copy->length;
+    }
+    block += data_size;
+
+    if (copy->tag) {
+        memcpy(block, copy->tag, tag_size);
+        copy->tag = block;
+        block += tag_size;
+    }
+
+    if (copy->anchor) {
+        memcpy(block, copy->anchor, anchor_size);
+        copy->anchor = block;
+    }
+
+    return 0;
 }
 
-static long
-PySyckParser_read_handler(char *buf, SyckIoFile *file, long max_size, long skip)
+static void
+PySyckTreeNode_free(PySyckTreeNode *node)
 {
-    PyGILState_STATE gs;
+    if (node->kind == syck_str_kind)
+        free(node->str);
+    else
+        free(node->items);
+}
 
-    PySyckParserObject *self = (PySyckParserObject *)file->ptr;
+/****************************************************************************
+ * The type _syck.Parser.
+ ****************************************************************************/
 
-    PyObject *value;
+PyDoc_STRVAR(PySyckParser_doc,
+    "Parser(source, implicit_typing=True, taguri_expansion=True,\n"
+    "       deferred=False, bufsize=0, select=None, offset=0,\n"
+    "       pause_gc=False, intern_keys=False, dedup_scalars=False)\n"
+    "      -> a Parser object\n\n"
+    "_syck.Parser is a low-lever wrapper of the Syck parser. It parses\n"
+    "a YAML stream and produces a tree of Nodes.\n\n"
+    "The source is a string, an object supporting the buffer interface\n"
+    "(e.g. mmap) or a file-like object. Buffers are parsed in place: a\n"
+    "buffer supporting the new interface (e.g. bytearray) is held until\n"
+    "the end of the stream; other buffers are read in chunks with the\n"
+    "global lock held and must not be truncated while parsed. Files and\n"
+    "integer file descriptors are read in C without the global lock.\n"
+    "'bufsize' sets the size of the input buffer if it is positive; strings\n"
+    "and buffers parsed in place use at least 4096 bytes.\n\n"
+    "'offset' is the position in a string or a buffer source where parsing\n"
+    "starts, e.g. an offset returned by scan_documents().\n\n"
+    "If 'pause_gc' is true, the cyclic garbage collector is disabled while\n"
+    "a document is parsed. The attribute 'stats' counts the parsed documents\n"
+    "and nodes, and estimates the number of collections avoided.\n\n"
+    "If 'intern_keys' is true, string mapping keys are interned. If\n"
+    "'dedup_scalars' is true, equal short scalars share one string object.\n\n"
+    "'select' is a path or a list of paths like 'services.*.endpoints'.\n"
+    "If it is given, only the nodes on these paths and their ancestors\n"
+    "are built; other keys and items are left out. It implies 'deferred'.\n\n"
+    "If 'deferred' is true, the parser does not call the Python API while\n"
+    "Syck parses a document. The document is stored in a native tree, and\n"
+    "the Python objects are built after the global lock is taken back.\n");
+
+/* Errors detected in the deferred mode, raised after syck_parse() returns. */
+
+enum {
+    PYSYCK_NO_ERROR,
+    PYSYCK_SYNTAX_ERROR,
+    PYSYCK_RECURSIVE_ERROR,
+    PYSYCK_MEMORY_ERROR,
+    PYSYCK_IO_ERROR,
+    PYSYCK_BUFFER_ERROR
+};
 
-    char *str;
-    int length;
+#define PYSYCK_ERROR_MESSAGE_SIZE   256
 
-    buf[skip] = '\0';
+#define PYSYCK_BUFFER_ERROR_MESSAGE \
+    "a token does not fit in the input buffer; increase 'bufsize'"
 
-    if (self->halt) {
-        return skip;
-    }
-    
-    max_size -= skip;
+/* The size of the tag and anchor caches, a power of 2. */
 
-    gs = PyGILState_Ensure();
+#define PYSYCK_STRING_CACHE_SIZE    64
 
-    value = PyObject_CallMethod(self->source, "read", "(i)", max_size);
-    if (!value) {
-        self->halt = 1;
+/* The size of the scalar cache, a power of 2, and the maximum length of
+ * scalars kept in it. */
 
-        PyGILState_Release(gs);
+#define PYSYCK_SCALAR_CACHE_SIZE    4096
+#define PYSYCK_SCALAR_CACHE_LENGTH  64
 
-        return skip;
-    }
+/* Marks of the deferred tree nodes for selective loading. */
 
-    if (!PyString_CheckExact(value)) {
-        Py_DECREF(value);
-        PyErr_SetString(PyExc_TypeError, "file-like object should return a string");
-        self->halt = 1;
-        
-        PyGILState_Release(gs);
+enum {
+    PYSYCK_SKIP,            /* the node is not selected */
+    PYSYCK_PARTIAL,         /* some descendants of the node are selected */
+    PYSYCK_FULL             /* the node is selected */
+};
 
-        return skip;
-    }
+typedef struct {
+    PyObject_HEAD
+    /* Attributes: */
+    PyObject *source;       /* a string or file-like object */
+    int implicit_typing;
+    int taguri_expansion;
+    int deferred;
+    int bufsize;
+    int pause_gc;
+    int intern_keys;
+    int dedup_scalars;
+    /* Internal fields: */
+    PyObject **symbols;     /* symbol table, indexed by SYMID-1 */
+    long symbols_length;    /* the number of symbols, 0 outside parse() */
+    long symbols_capacity;  /* the table is kept between parse() calls */
+    SyckParser *parser;
+    int parsing;
+    int halt;
+    int native;             /* build Python objects instead of Nodes */
+    long native_types;      /* core types built in C, a mask */
+    PyObject *construct;    /* self.construct, NULL outside load_native() */
+    PyObject *events;       /* the callback, NULL outside parse_events() */
+    long events_count;      /* the number of reported nodes */
+    PySyckTreeNode *tree;   /* nodes stored in the deferred mode */
+    long tree_length;
+    long tree_capacity;
+    PyObject *select;       /* selected paths, a tuple of tuples, or NULL */
+    char *marks;            /* marks of the tree nodes, NULL unless selecting */
+    int error;              /* an error detected in the deferred mode */
+    char error_message[PYSYCK_ERROR_MESSAGE_SIZE];
+    int error_line;
+    int error_column;
+    int error_errno;
+    FILE *stream;           /* the FILE of a file source, or NULL */
+    int fd;                 /* a file descriptor source, or -1 */
+    Py_ssize_t position;    /* the next byte of a buffer read by chunks */
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    Py_buffer view;         /* holds a buffer source */
+    int view_held;
+#endif
+    int gc_paused;          /* whether parse() has disabled the cyclic GC */
+    long gc_count;          /* the generation 0 count when it was disabled */
+    PyObject *tags[PYSYCK_STRING_CACHE_SIZE];       /* recent tags */
+    PyObject *anchors[PYSYCK_STRING_CACHE_SIZE];    /* recent anchors */
+    PyObject **scalars;     /* recent short scalars, NULL unless deduping */
+    PyObject *date;         /* the last date-only timestamp, or NULL */
+    char date_key[10];      /* its value, 'YYYY-MM-DD' */
+    /* Statistics: */
+    long documents;
+    long nodes;
+    long collections_avoided;
+} PySyckParserObject;
 
-    str = PyString_AS_STRING(value);
-    length = PyString_GET_SIZE(value);
-    if (!length) {
-        Py_DECREF(value);
+static PyObject *
+PySyckParser_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PySyckParserObject *self;
 
-        PyGILState_Release(gs);
+    self = (PySyckParserObject *)type->tp_alloc(type, 0);
+    if (!self) return NULL;
 
-        return skip;
-    }
+    self->source = NULL;
+    self->implicit_typing = 0;
+    self->taguri_expansion = 0;
+    self->deferred = 0;
+    self->bufsize = 0;
+    self->position = 0;
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    self->view_held = 0;
+#endif
+    self->symbols = NULL;
+    self->symbols_length = 0;
+    self->symbols_capacity = 0;
+    self->parser = NULL;
+    self->parsing = 0;
+    self->halt = 1;
+    self->native = 0;
+    self->native_types = 0;
+    self->construct = NULL;
+    self->events = NULL;
+    self->events_count = 0;
+    self->tree = NULL;
+    self->tree_length = 0;
+    self->tree_capacity = 0;
+    self->select = NULL;
+    self->marks = NULL;
+    self->error = PYSYCK_NO_ERROR;
+    self->stream = NULL;
+    self->fd = -1;
+    self->pause_gc = 0;
+    self->gc_paused = 0;
+    self->gc_count = -1;
+    memset(self->tags, 0, sizeof(self->tags));
+    memset(self->anchors, 0, sizeof(self->anchors));
+    self->intern_keys = 0;
+    self->dedup_scalars = 0;
+    self->scalars = NULL;
+    self->date = NULL;
+    self->documents = 0;
+    self->nodes = 0;
+    self->collections_avoided = 0;
 
-    if (length > max_size) {
-        Py_DECREF(value);
-        PyErr_SetString(PyExc_ValueError, "read returns an overly long string");
-        self->halt = 1;
+    return (PyObject *)self;
+}
 
-        PyGILState_Release(gs);
+/* Returns a string object equal to 'str'. The cache of 'size' slots is
+ * direct-mapped: the slot of a string is given by its hash, and a miss
+ * replaces the slot. Tags are also interned, so all nodes with the same tag
+ * share one object. */
 
-        return skip;
+static PyObject *
+PySyck_cached_string(PyObject **cache, int size,
+        const char *str, Py_ssize_t length, int intern)
+{
+    unsigned long hash = 5381;
+    Py_ssize_t k;
+    PyObject **slot;
+    PyObject *string;
+
+    for (k = 0; k < length; k++)
+        hash = hash*33 + (unsigned char)str[k];
+    slot = cache + (hash & (size-1));
+
+    if (*slot && PyString_GET_SIZE(*slot) == length
+            && memcmp(PyString_AS_STRING(*slot), str, length) == 0) {
+        Py_INCREF(*slot);
+        return *slot;
     }
 
-    memcpy(buf+skip, str, length);
-    length += skip;
-    buf[length] = '\0';
-
-    Py_DECREF(value);
+    string = PyString_FromStringAndSize(str, length);
+    if (!string) return NULL;
+    if (intern)
+        PyString_InternInPlace(&string);
 
-    PyGILState_Release(gs);
+    Py_XDECREF(*slot);
+    Py_INCREF(string);
+    *slot = string;
 
-    return length;
+    return string;
 }
 
-static int
-PySyckParser_init(PySyckParserObject *self, PyObject *args, PyObject *kwds)
+static PyObject *
+PySyckParser_build_tag(PySyckParserObject *self, const char *tag)
 {
-    PyObject *source = NULL;
-    int implicit_typing = 1;
-    int taguri_expansion = 1;
+    return PySyck_cached_string(self->tags, PYSYCK_STRING_CACHE_SIZE,
+            tag, strlen(tag), 1);
+}
 
-    static char *kwdlist[] = {"source", "implicit_typing", "taguri_expansion",
-        NULL};
+static PyObject *
+PySyckParser_build_anchor(PySyckParserObject *self, const char *anchor)
+{
+    return PySyck_cached_string(self->anchors, PYSYCK_STRING_CACHE_SIZE,
+            anchor, strlen(anchor), 0);
+}
 
-    PySyckParser_clear(self);
+/* Returns the value of a scalar node, shared with equal short scalars if
+ * 'dedup_scalars' is set. */
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii", kwdlist,
-                &source, &implicit_typing, &taguri_expansion))
-        return -1;
+static PyObject *
+PySyckParser_build_string(PySyckParserObject *self,
+        const char *str, Py_ssize_t length)
+{
+    if (!self->scalars || length > PYSYCK_SCALAR_CACHE_LENGTH)
+        return PyString_FromStringAndSize(str, length);
+    return PySyck_cached_string(self->scalars, PYSYCK_SCALAR_CACHE_SIZE,
+            str, length, 0);
+}
 
-    Py_INCREF(source);
-    self->source = source;
+/* Converts a timestamp. Records often repeat the same date, so the last
+ * date-only value is kept and reused. */
 
-    self->implicit_typing = implicit_typing;
-    self->taguri_expansion = taguri_expansion;
+static int
+PySyckParser_construct_timestamp(PySyckParserObject *self,
+        const char *str, Py_ssize_t length, PyObject **result)
+{
+    int ret;
 
-    self->parser = syck_new_parser();
-    self->parser->bonus = self;
+    if (length == sizeof(self->date_key) && self->date
+            && memcmp(self->date_key, str, length) == 0) {
+        Py_INCREF(self->date);
+        *result = self->date;
+        return 1;
+    }
 
-    if (PyString_CheckExact(self->source)) {
-        syck_parser_str(self->parser,
-                PyString_AS_STRING(self->source),
-                PyString_GET_SIZE(self->source), NULL);
+    ret = PySyck_construct_timestamp(str, length, result);
+    if (ret > 0 && length == sizeof(self->date_key)) {
+        Py_XDECREF(self->date);
+        Py_INCREF(*result);
+        self->date = *result;
+        memcpy(self->date_key, str, length);
     }
-    /*
-    else if (PyUnicode_CheckExact(self->source)) {
-        syck_parser_str(self->parser,
-                PyUnicode_AS_DATA(self->source),
-                PyString_GET_DATA_SIZE(self->source), NULL);
+
+    return ret;
+}
+
+/* Interns a string mapping key in place, if 'intern_keys' is set. 'key' is
+ * a string or a scalar node holding the string. */
+
+static void
+PySyckParser_intern_key(PySyckParserObject *self, PyObject **key)
+{
+    PySyckNodeObject *node;
+
+    if (!self->intern_keys)
+        return;
+    if (PyString_CheckExact(*key)) {
+        PyString_InternInPlace(key);
     }
-    */
-    else {
-        syck_parser_file(self->parser, (FILE *)self, PySyckParser_read_handler);
+    else if (PyObject_TypeCheck(*key, &PySyckScalar_Type)) {
+        node = (PySyckNodeObject *)*key;
+        if (node->value && PyString_CheckExact(node->value))
+            PyString_InternInPlace(&node->value);
     }
+}
 
-    syck_parser_implicit_typing(self->parser, self->implicit_typing);
-    syck_parser_taguri_expansion(self->parser, self->taguri_expansion);
+static void
+PySyck_clear_cache(PyObject **cache, int size)
+{
+    PyObject *tmp;
+    int k;
 
-    syck_parser_handler(self->parser, PySyckParser_node_handler);
-    syck_parser_error_handler(self->parser, PySyckParser_error_handler);
-    syck_parser_bad_anchor_handler(self->parser, PySyckParser_bad_anchor_handler);
+    for (k = 0; k < size; k++) {
+        tmp = cache[k];
+        cache[k] = NULL;
+        Py_XDECREF(tmp);
+    }
+}
 
-    self->parsing = 0;
-    self->halt = 0;
+/* The symbol table. Symbols are added in the order Syck reports nodes, so
+ * SYMID-1 is the index of the symbol. */
+
+static int
+PySyckParser_add_symbol(PySyckParserObject *self, PyObject *object)
+{
+    PyObject **symbols;
+    long capacity;
+
+    if (self->symbols_length == self->symbols_capacity) {
+        capacity = self->symbols_capacity ? 2*self->symbols_capacity : 64;
+        symbols = realloc(self->symbols, capacity*sizeof(PyObject *));
+        if (!symbols) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->symbols = symbols;
+        self->symbols_capacity = capacity;
+    }
 
+    Py_INCREF(object);
+    self->symbols[self->symbols_length++] = object;
     return 0;
 }
 
 static PyObject *
-PySyckParser_parse(PySyckParserObject *self)
+PySyckParser_get_symbol(PySyckParserObject *self, long index)
 {
-    SYMID index;
-    PyObject *value;
+    if (index < 0 || index >= self->symbols_length) {
+        PyErr_SetString(PyExc_IndexError, "symbol index out of range");
+        return NULL;
+    }
+    return self->symbols[index];
+}
 
-    if (self->parsing) {
-        PyErr_SetString(PyExc_RuntimeError,
-                "do not call Parser.parse while it is already running");
-        return NULL;
-    }
-
-    if (self->halt) {
-        Py_INCREF(Py_None);
-        return Py_None;
-    }
+static void
+PySyckParser_clear_symbols(PySyckParserObject *self)
+{
+    PyObject *object;
 
-    self->symbols = PyList_New(0);
-    if (!self->symbols) {
-        return NULL;
+    while (self->symbols_length > 0) {
+        object = self->symbols[--self->symbols_length];
+        Py_DECREF(object);
     }
+}
 
-    self->parsing = 1;
-    Py_BEGIN_ALLOW_THREADS
-    index = syck_parse(self->parser)-1;
-    Py_END_ALLOW_THREADS
-    self->parsing = 0;
+static void
+PySyckParser_clear_tree(PySyckParserObject *self)
+{
+    long k;
 
-    if (self->halt || self->parser->eof) {
-        Py_DECREF(self->symbols);
-        self->symbols = NULL;
+    for (k = 0; k < self->tree_length; k++)
+        PySyckTreeNode_free(self->tree+k);
+    self->tree_length = 0;
+}
 
-        if (self->halt) return NULL;
+/* Holds a buffer source that supports the new buffer interface, so that it
+ * cannot be resized while it is parsed in place without the GIL. Returns 1 if
+ * the source is held and 0 if it does not support the interface. */
 
-        self->halt = 1;
-        Py_INCREF(Py_None);
-        return Py_None;
+static int
+PySyckParser_hold_source(PySyckParserObject *self,
+        const void **buffer, Py_ssize_t *length)
+{
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    if (PyObject_CheckBuffer(self->source)) {
+        if (PyObject_GetBuffer(self->source, &self->view, PyBUF_SIMPLE) < 0)
+            return -1;
+        self->view_held = 1;
+        *buffer = self->view.buf;
+        *length = self->view.len;
+        return 1;
     }
+#endif
 
-    value = PyList_GetItem(self->symbols, index);
-    Py_XINCREF(value);
-
-    Py_DECREF(self->symbols);
-    self->symbols = NULL;
-
-    return value;
+    return 0;
 }
 
-PyDoc_STRVAR(PySyckParser_parse_doc,
-    "parse() -> the root Node object\n\n"
-    "Parses the source and returns the root of the Node tree. Call it\n"
-    "several times to retrieve all documents from the source. On EOF,\n"
-    "returns None and sets the 'eof' attribute on.\n");
-
-static PyMethodDef PySyckParser_methods[] = {
-    {"parse",  (PyCFunction)PySyckParser_parse,
-        METH_NOARGS, PySyckParser_parse_doc},
-    {NULL}  /* Sentinel */
-};
-
-static PyTypeObject PySyckParser_Type = {
-    PyObject_HEAD_INIT(NULL)
-    0,                                          /* ob_size */
-    "_syck.Parser",                             /* tp_name */
-    sizeof(PySyckParserObject),                 /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)PySyckParser_dealloc,           /* tp_dealloc */
-    0,                                          /* tp_print */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_compare */
-    0,                                          /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    0,                                          /* tp_getattro */
-    0,                                          /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE|Py_TPFLAGS_HAVE_GC,  /* tp_flags */
-    PySyckParser_doc,                           /* tp_doc */
-    (traverseproc)PySyckParser_traverse,        /* tp_traverse */
-    (inquiry)PySyckParser_clear,                /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    PySyckParser_methods,                       /* tp_methods */
-    0,                                          /* tp_members */
-    PySyckParser_getsetters,                    /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)PySyckParser_init,                /* tp_init */
-    0,                                          /* tp_alloc */
-    PySyckParser_new,                           /* tp_new */
-};
-
-/****************************************************************************
- * The type _syck.Emitter.
- ****************************************************************************/
-
-PyDoc_STRVAR(PySyckEmitter_doc,
-    "Emitter(output, headless=False, use_header=False, use_version=False,\n"
-    "        explicit_typing=True, style=None, best_width=80, indent=2)\n"
-    "                -> an Emitter object\n\n"
-    "_syck.Emitter is a low-lever wrapper of the Syck emitter. It emits\n"
-    "a tree of Nodes into a YAML stream.\n");
-
-typedef struct {
-    PyObject_HEAD
-    /* Attributes: */
-    PyObject *output;       /* a file-like object */
-    int headless;
-    int use_header;
-    int use_version;
-    int explicit_typing;
-    enum scalar_style style;
-    int best_width;
-    int indent;
-    /* Internal fields: */
-    PyObject *symbols;      /* symbol table, a list, NULL outside emit() */
-    PyObject *nodes;        /* node -> symbol, a dict, NULL outside emit() */
-    SyckEmitter *emitter;
-    int emitting;
-    int halt;
-} PySyckEmitterObject;
+/* Releases a buffer source once the parser does not read it. */
 
-static PyObject *
-PySyckEmitter_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+static void
+PySyckParser_release_source(PySyckParserObject *self)
 {
-    PySyckEmitterObject *self;
-
-    self = (PySyckEmitterObject *)type->tp_alloc(type, 0);
-    if (!self) return NULL;
-
-    self->output = NULL;
-    self->headless = 0;
-    self->use_header = 0;
-    self->use_version = 0;
-    self->explicit_typing = 0;
-    self->style = scalar_none;
-    self->best_width = 0;
-    self->indent = 0;
-    self->symbols = NULL;
-    self->nodes = NULL;
-    self->emitter = NULL;
-    self->emitting = 0;
-    self->halt = 1;
-
-    return (PyObject *)self;
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    if (self->view_held) {
+        PyBuffer_Release(&self->view);
+        self->view_held = 0;
+    }
+#endif
 }
 
 static int
-PySyckEmitter_clear(PySyckEmitterObject *self)
+PySyckParser_clear(PySyckParserObject *self)
 {
     PyObject *tmp;
 
-    if (self->emitter) {
-        syck_free_emitter(self->emitter);
-        self->emitter = NULL;
+    if (self->parser) {
+        syck_free_parser(self->parser);
+        self->parser = NULL;
     }
 
-    tmp = self->output;
-    self->output = NULL;
+    PySyckParser_clear_tree(self);
+    free(self->tree);
+    self->tree = NULL;
+    self->tree_capacity = 0;
+
+    PySyckParser_release_source(self);
+
+    tmp = self->source;
+    self->source = NULL;
     Py_XDECREF(tmp);
 
-    tmp = self->symbols;
+    PySyckParser_clear_symbols(self);
+    free(self->symbols);
     self->symbols = NULL;
+    self->symbols_capacity = 0;
+
+    PySyck_clear_cache(self->tags, PYSYCK_STRING_CACHE_SIZE);
+    PySyck_clear_cache(self->anchors, PYSYCK_STRING_CACHE_SIZE);
+    if (self->scalars) {
+        PySyck_clear_cache(self->scalars, PYSYCK_SCALAR_CACHE_SIZE);
+        free(self->scalars);
+        self->scalars = NULL;
+    }
+
+    tmp = self->date;
+    self->date = NULL;
+    Py_XDECREF(tmp);
+
+    tmp = self->construct;
+    self->construct = NULL;
     Py_XDECREF(tmp);
 
-    tmp = self->nodes;
-    self->nodes = NULL;
+    tmp = self->events;
+    self->events = NULL;
+    Py_XDECREF(tmp);
+
+    tmp = self->select;
+    self->select = NULL;
     Py_XDECREF(tmp);
 
     return 0;
 }
 
 static int
-PySyckEmitter_traverse(PySyckEmitterObject *self, visitproc visit, void *arg)
+PySyckParser_traverse(PySyckParserObject *self, visitproc visit, void *arg)
 {
     int ret;
+    long k;
 
-    if (self->output)
-        if ((ret = visit(self->output, arg)) != 0)
+    if (self->source)
+        if ((ret = visit(self->source, arg)) != 0)
             return ret;
 
-    if (self->symbols)
-        if ((ret = visit(self->symbols, arg)) != 0)
+    for (k = 0; k < self->symbols_length; k++)
+        if ((ret = visit(self->symbols[k], arg)) != 0)
             return ret;
 
-    if (self->nodes)
-        if ((ret = visit(self->nodes, arg)) != 0)
+    if (self->construct)
+        if ((ret = visit(self->construct, arg)) != 0)
+            return ret;
+
+    if (self->events)
+        if ((ret = visit(self->events, arg)) != 0)
             return ret;
 
     return 0;
 }
 
 static void
-PySyckEmitter_dealloc(PySyckEmitterObject *self)
+PySyckParser_dealloc(PySyckParserObject *self)
 {
-    PySyckEmitter_clear(self);
+    PySyckParser_clear(self);
     self->ob_type->tp_free((PyObject *)self);
 }
 
 static PyObject *
-PySyckEmitter_getoutput(PySyckEmitterObject *self, void *closure)
+PySyckParser_getsource(PySyckParserObject *self, void *closure)
 {
-    PyObject *value = self->output ? self->output : Py_None;
+    PyObject *value = self->source ? self->source : Py_None;
 
     Py_INCREF(value);
     return value;
 }
 
 static PyObject *
-PySyckEmitter_getheadless(PySyckEmitterObject *self, void *closure)
+PySyckParser_getimplicit_typing(PySyckParserObject *self, void *closure)
 {
-    PyObject *value = self->headless ? Py_True : Py_False;
+    PyObject *value = self->implicit_typing ? Py_True : Py_False;
 
     Py_INCREF(value);
     return value;
 }
 
 static PyObject *
-PySyckEmitter_getuse_header(PySyckEmitterObject *self, void *closure)
+PySyckParser_gettaguri_expansion(PySyckParserObject *self, void *closure)
 {
-    PyObject *value = self->use_header ? Py_True : Py_False;
+    PyObject *value = self->taguri_expansion ? Py_True : Py_False;
 
     Py_INCREF(value);
     return value;
 }
 
 static PyObject *
-PySyckEmitter_getuse_version(PySyckEmitterObject *self, void *closure)
+PySyckParser_getdeferred(PySyckParserObject *self, void *closure)
 {
-    PyObject *value = self->use_version ? Py_True : Py_False;
+    PyObject *value = self->deferred ? Py_True : Py_False;
 
     Py_INCREF(value);
     return value;
 }
 
 static PyObject *
-PySyckEmitter_getexplicit_typing(PySyckEmitterObject *self, void *closure)
+PySyckParser_getbufsize(PySyckParserObject *self, void *closure)
 {
-    PyObject *value = self->explicit_typing ? Py_True : Py_False;
+    return PyInt_FromLong(self->parser ? self->parser->bufsize : 0);
+}
+
+static PyObject *
+PySyckParser_getpause_gc(PySyckParserObject *self, void *closure)
+{
+    PyObject *value = self->pause_gc ? Py_True : Py_False;
 
     Py_INCREF(value);
     return value;
 }
 
 static PyObject *
-PySyckEmitter_getstyle(PySyckEmitterObject *self, void *closure)
+PySyckParser_getintern_keys(PySyckParserObject *self, void *closure)
 {
-    PyObject *value;
+    PyObject *value = self->intern_keys ? Py_True : Py_False;
 
-    switch (self->style) {
-        case scalar_1quote: value = PySyck_1QuoteStyle; break;
-        case scalar_2quote: value = PySyck_2QuoteStyle; break;
-        case scalar_fold: value = PySyck_FoldStyle; break;
-        case scalar_literal: value = PySyck_LiteralStyle; break;
-        case scalar_plain: value = PySyck_PlainStyle; break;
-        default: value = Py_None;
-    }
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckParser_getdedup_scalars(PySyckParserObject *self, void *closure)
+{
+    PyObject *value = self->dedup_scalars ? Py_True : Py_False;
 
     Py_INCREF(value);
     return value;
 }
 
 static PyObject *
-PySyckEmitter_getbest_width(PySyckEmitterObject *self, void *closure)
+PySyckParser_getstats(PySyckParserObject *self, void *closure)
 {
-    return PyInt_FromLong(self->best_width);
+    return Py_BuildValue("{sl,sl,sl}", "documents", self->documents,
+            "nodes", self->nodes,
+            "collections_avoided", self->collections_avoided);
 }
 
 static PyObject *
-PySyckEmitter_getindent(PySyckEmitterObject *self, void *closure)
+PySyckParser_geteof(PySyckParserObject *self, void *closure)
 {
-    return PyInt_FromLong(self->indent);
+    PyObject *value = self->halt ? Py_True : Py_False;
+
+    Py_INCREF(value);
+    return value;
 }
 
-static PyGetSetDef PySyckEmitter_getsetters[] = {
-    {"output", (getter)PySyckEmitter_getoutput, NULL,
-        PyDoc_STR("output stream, a file-like object"), NULL},
-    {"headless", (getter)PySyckEmitter_getheadless, NULL,
-        PyDoc_STR("headerless document flag"), NULL},
-    {"use_header", (getter)PySyckEmitter_getuse_header, NULL,
-        PyDoc_STR("force header flag"), NULL},
-    {"use_version", (getter)PySyckEmitter_getuse_version, NULL,
-        PyDoc_STR("force version flag"), NULL},
-    {"explicit_typing", (getter)PySyckEmitter_getexplicit_typing, NULL,
-        PyDoc_STR("explicit typing for all collections"), NULL},
-    {"style", (getter)PySyckEmitter_getstyle, NULL,
-        PyDoc_STR("use literal or folded blocks on all text"), NULL},
-    {"best_width", (getter)PySyckEmitter_getbest_width, NULL,
-        PyDoc_STR("best width for folded scalars"), NULL},
-    {"indent", (getter)PySyckEmitter_getindent, NULL,
-        PyDoc_STR("default indentation"), NULL},
+static PyGetSetDef PySyckParser_getsetters[] = {
+    {"source", (getter)PySyckParser_getsource, NULL,
+        PyDoc_STR("IO source, a string or a file-like object"), NULL},
+    {"implicit_typing", (getter)PySyckParser_getimplicit_typing, NULL,
+        PyDoc_STR("implicit typing of builtin YAML types"), NULL},
+    {"taguri_expansion", (getter)PySyckParser_gettaguri_expansion, NULL,
+        PyDoc_STR("expansion of types in full taguri"), NULL},
+    {"deferred", (getter)PySyckParser_getdeferred, NULL,
+        PyDoc_STR("building of Python objects after a document is parsed"),
+        NULL},
+    {"bufsize", (getter)PySyckParser_getbufsize, NULL,
+        PyDoc_STR("the size of the input buffer"), NULL},
+    {"pause_gc", (getter)PySyckParser_getpause_gc, NULL,
+        PyDoc_STR("pausing of the cyclic GC while a document is parsed"),
+        NULL},
+    {"intern_keys", (getter)PySyckParser_getintern_keys, NULL,
+        PyDoc_STR("interning of string mapping keys"), NULL},
+    {"dedup_scalars", (getter)PySyckParser_getdedup_scalars, NULL,
+        PyDoc_STR("sharing of equal short scalars"), NULL},
+    {"stats", (getter)PySyckParser_getstats, NULL,
+        PyDoc_STR("a dictionary of parsing statistics"), NULL},
+    {"eof", (getter)PySyckParser_geteof, NULL,
+        PyDoc_STR("EOF flag"), NULL},
     {NULL}  /* Sentinel */
 };
 
-static void
-PySyckEmitter_node_handler(SyckEmitter *emitter, st_data_t id)
+static PyObject *
+PySyckParser_build_node(PySyckParserObject *self, PySyckTreeNode *node)
 {
-    PyGILState_STATE gs;
-
-    PySyckEmitterObject *self = (PySyckEmitterObject *)emitter->bonus;
+    PySyckNodeObject *object = NULL;
 
-    PySyckNodeObject *node;
-    char *tag = NULL;
-    PyObject *index;
-    PyObject *key, *value, *item, *pair;
-    int j, k, l;
-    char *str;
-    int len;
-    int dict_pos;
+    SYMID index;
+    PyObject *key, *item;
+    PyObject *value = NULL;
+    int k;
 
-    if (self->halt) return;
+    /* Build the value first, so that the node is created holding it. */
 
-    gs = PyGILState_Ensure();
+    switch (node->kind) {
 
-    node = (PySyckNodeObject *)PyList_GetItem(self->symbols, id);
-    if (!node) {
-        PyErr_SetString(PyExc_RuntimeError, "unknown data id");
-        self->halt = 1;
-        PyGILState_Release(gs);
+        case syck_str_kind:
+            value = PySyckParser_build_string(self, node->str, node->length);
+            if (!value) goto error;
+            object = (PySyckNodeObject *)
+                PySyckScalar_create(&PySyckScalar_Type, value);
+            /* A scalar refers only to strings, so it is never in a cycle. */
+            if (object)
+                PyObject_GC_UnTrack(object);
+            break;
+
+        case syck_seq_kind:
+            value = PyList_New(node->length);
+            if (!value) goto error;
+            for (k = 0; k < node->length; k++) {
+                index = node->items[k]-1;
+                item = PySyckParser_get_symbol(self, index);
+                if (!item) goto error;
+                Py_INCREF(item);
+                PyList_SET_ITEM(value, k, item);
+            }
+            object = (PySyckNodeObject *)
+                PySyckSeq_create(&PySyckSeq_Type, value);
+            break;
+
+        case syck_map_kind:
+            value = PyDict_New();
+            if (!value) goto error;
+            for (k = 0; k < node->length; k++)
+            {
+                index = node->items[k]-1;
+                key = PySyckParser_get_symbol(self, index);
+                if (!key) goto error;
+                PySyckParser_intern_key(self, &self->symbols[index]);
+                key = self->symbols[index];
+                index = node->values[k]-1;
+                item = PySyckParser_get_symbol(self, index);
+                if (!item) goto error;
+                if (PyDict_SetItem(value, key, item) < 0)
+                    goto error;
+            }
+            object = (PySyckNodeObject *)
+                PySyckMap_create(&PySyckMap_Type, value);
+            break;
+    }
+    /* The reference to the value is stolen by the node. */
+    value = NULL;
+    if (!object) goto error;
+
+    if (node->tag) {
+        object->tag = PySyckParser_build_tag(self, node->tag);
+        if (!object->tag) goto error;
+    }
+
+    if (node->anchor) {
+        object->anchor = PySyckParser_build_anchor(self, node->anchor);
+        if (!object->anchor) goto error;
+    }
+
+    return (PyObject *)object;
+
+error:
+    Py_XDECREF(value);
+    Py_XDECREF(object);
+    return NULL;
+}
+
+/* Builds the Python object for a node in the load_native() mode. The values
+ * of collections are built from the objects already stored in the symbol
+ * table, so every node is converted exactly once. Nodes of the core types
+ * are converted in C; other nodes are wrapped and passed to construct(). */
+
+static PyObject *
+PySyckParser_build_object(PySyckParserObject *self, PySyckTreeNode *node)
+{
+    PySyckNodeObject *object = NULL;
+    PyObject *result = NULL;
+    PyObject *value = NULL;
+
+    SYMID index;
+    PyObject *key, *item, *pair;
+    int type = PYSYCK_OTHER;
+    int core = 1;
+    int k, ret;
+
+    if (node->tag) {
+        type = PySyck_find_core_type(node->tag);
+        if (type != PYSYCK_OTHER
+                && (!(self->native_types & (1L << type))
+                    || PySyck_CoreTypes[type].kind != node->kind))
+            type = PYSYCK_OTHER;
+    }
+
+    switch (node->kind) {
+
+        case syck_str_kind:
+            if (node->tag) {
+                if (PYSYCK_IS_TIMESTAMP(type))
+                    ret = PySyckParser_construct_timestamp(self,
+                            node->str, node->length, &result);
+                else
+                    ret = PySyck_construct_direct(type,
+                            node->str, node->length, &result);
+                if (ret < 0) goto error;
+                if (ret > 0)
+                    return result;
+            }
+            value = PySyckParser_build_string(self, node->str, node->length);
+            if (!value) goto error;
+            if (!node->tag)
+                return value;
+            ret = PySyck_construct_scalar(type, value, &result);
+            if (ret < 0) goto error;
+            if (ret > 0) {
+                Py_DECREF(value);
+                return result;
+            }
+            break;
+
+        case syck_seq_kind:
+            value = PyList_New(node->length);
+            if (!value) goto error;
+            for (k = 0; k < node->length; k++) {
+                index = node->items[k]-1;
+                item = PySyckParser_get_symbol(self, index);
+                if (!item) goto error;
+                Py_INCREF(item);
+                PyList_SET_ITEM(value, k, item);
+            }
+            if (!node->tag || type == PYSYCK_SEQ)
+                return value;
+            break;
+
+        case syck_map_kind:
+            value = PyDict_New();
+            if (!value) goto error;
+            for (k = 0; k < node->length; k++) {
+                index = node->items[k]-1;
+                key = PySyckParser_get_symbol(self, index);
+                if (!key) goto error;
+                PySyckParser_intern_key(self, &self->symbols[index]);
+                key = self->symbols[index];
+                index = node->values[k]-1;
+                item = PySyckParser_get_symbol(self, index);
+                if (!item) goto error;
+                if (!PySyck_is_core_key(key))
+                    core = 0;
+                ret = PySequence_Contains(value, key);
+                if (ret < 0) {
+                    if (!PyErr_ExceptionMatches(PyExc_TypeError))
+                        goto error;
+                    PyErr_Clear();
+                }
+                if (ret != 0)
+                    break;
+                if (PyDict_SetItem(value, key, item) < 0)
+                    goto error;
+            }
+            if (k < node->length) {
+                /* An unhashable or duplicate key: use a list of pairs,
+                 * reusing the already converted keys and values. */
+                Py_DECREF(value);
+                value = PyList_New(node->length);
+                if (!value) goto error;
+                for (k = 0; k < node->length; k++) {
+                    index = node->items[k]-1;
+                    key = PySyckParser_get_symbol(self, index);
+                    if (!key) goto error;
+                    index = node->values[k]-1;
+                    item = PySyckParser_get_symbol(self, index);
+                    if (!item) goto error;
+                    pair = Py_BuildValue("(OO)", key, item);
+                    if (!pair) goto error;
+                    PyList_SET_ITEM(value, k, pair);
+                }
+            }
+            if (core && (!node->tag || type == PYSYCK_MAP))
+                return value;
+            break;
+    }
+
+    if (!self->construct)
+        return value;
+
+    /* The node takes the reference to the value. */
+    switch (node->kind) {
+        case syck_str_kind:
+            object = (PySyckNodeObject *)
+                PySyckScalar_create(&PySyckScalar_Type, value);
+            break;
+        case syck_seq_kind:
+            object = (PySyckNodeObject *)
+                PySyckSeq_create(&PySyckSeq_Type, value);
+            break;
+        case syck_map_kind:
+            object = (PySyckNodeObject *)
+                PySyckMap_create(&PySyckMap_Type, value);
+            break;
+    }
+    value = NULL;
+    if (!object) goto error;
+
+    if (node->tag) {
+        object->tag = PySyckParser_build_tag(self, node->tag);
+        if (!object->tag) goto error;
+    }
+
+    if (node->anchor) {
+        object->anchor = PySyckParser_build_anchor(self, node->anchor);
+        if (!object->anchor) goto error;
+    }
+
+    result = PyObject_CallFunctionObjArgs(self->construct, object, NULL);
+    Py_DECREF(object);
+    return result;
+
+error:
+    Py_XDECREF(value);
+    Py_XDECREF(object);
+    return NULL;
+}
+
+static PyObject *
+PySyckParser_build_event(PySyckParserObject *self, PySyckTreeNode *node)
+{
+    PyObject *kind = NULL;
+    PyObject *value = NULL;
+    PyObject *tag = NULL;
+    PyObject *anchor = NULL;
+    PyObject *item;
+    PyObject *event;
+    long k;
+
+    switch (node->kind) {
+
+        case syck_str_kind:
+            kind = PySyck_ScalarKind;
+            value = PySyckParser_build_string(self, node->str, node->length);
+            if (!value) return NULL;
+            break;
+
+        case syck_seq_kind:
+            kind = PySyck_SeqKind;
+            value = PyTuple_New(node->length);
+            if (!value) return NULL;
+            for (k = 0; k < node->length; k++) {
+                item = PyInt_FromLong(node->items[k]);
+                if (!item) goto error;
+                PyTuple_SET_ITEM(value, k, item);
+            }
+            break;
+
+        case syck_map_kind:
+            kind = PySyck_MapKind;
+            value = PyTuple_New(node->length);
+            if (!value) return NULL;
+            for (k = 0; k < node->length; k++) {
+                item = Py_BuildValue("(ll)", node->items[k], node->values[k]);
+                if (!item) goto error;
+                PyTuple_SET_ITEM(value, k, item);
+            }
+            break;
+    }
+
+    if (node->tag) {
+        tag = PySyckParser_build_tag(self, node->tag);
+        if (!tag) goto error;
+    }
+    else {
+        Py_INCREF(Py_None);
+        tag = Py_None;
+    }
+
+    if (node->anchor) {
+        anchor = PySyckParser_build_anchor(self, node->anchor);
+        if (!anchor) goto error;
+    }
+    else {
+        Py_INCREF(Py_None);
+        anchor = Py_None;
+    }
+
+    event = Py_BuildValue("(OlOOO)", kind, self->events_count+1,
+            tag, anchor, value);
+    Py_DECREF(value);
+    Py_DECREF(tag);
+    Py_DECREF(anchor);
+    return event;
+
+error:
+    Py_DECREF(value);
+    Py_XDECREF(tag);
+    return NULL;
+}
+
+static SYMID
+PySyckParser_report_node(PySyckParserObject *self, SyckNode *node)
+{
+    PyGILState_STATE gs;
+
+    PySyckTreeNode view;
+    PyObject *event;
+    PyObject *result;
+
+    gs = PyGILState_Ensure();
+
+    PySyckTreeNode_view(&view, node);
+    event = PySyckParser_build_event(self, &view);
+    if (!event) goto error;
+
+    result = PyObject_CallObject(self->events, event);
+    Py_DECREF(event);
+    if (!result) goto error;
+    Py_DECREF(result);
+
+    PyGILState_Release(gs);
+    return ++self->events_count;
+
+error:
+    PyGILState_Release(gs);
+    self->halt = 1;
+    return -1;
+}
+
+static SYMID
+PySyckParser_defer_node(PySyckParserObject *self, SyckNode *node)
+{
+    PySyckTreeNode *tree;
+    long capacity;
+
+    if (self->tree_length == self->tree_capacity) {
+        capacity = self->tree_capacity ? 2*self->tree_capacity : 64;
+        tree = realloc(self->tree, capacity*sizeof(PySyckTreeNode));
+        if (!tree) goto error;
+        self->tree = tree;
+        self->tree_capacity = capacity;
+    }
+
+    if (PySyckTreeNode_copy(self->tree+self->tree_length, node) < 0)
+        goto error;
+
+    return ++self->tree_length;
+
+error:
+    self->error = PYSYCK_MEMORY_ERROR;
+    self->halt = 1;
+    return -1;
+}
+
+static SYMID
+PySyckParser_node_handler(SyckParser *parser, SyckNode *node)
+{
+    PyGILState_STATE gs;
+
+    PySyckParserObject *self = (PySyckParserObject *)parser->bonus;
+
+    PySyckTreeNode view;
+    SYMID index;
+    PyObject *object;
+
+    if (self->halt)
+        return -1;
+
+    self->nodes++;
+
+    if (self->events)
+        return PySyckParser_report_node(self, node);
+
+    if (self->deferred)
+        return PySyckParser_defer_node(self, node);
+
+    gs = PyGILState_Ensure();
+
+    PySyckTreeNode_view(&view, node);
+    if (self->native)
+        object = PySyckParser_build_object(self, &view);
+    else
+        object = PySyckParser_build_node(self, &view);
+    if (!object) goto error;
+
+    if (PySyckParser_add_symbol(self, object) < 0)
+        goto error;
+
+    Py_DECREF(object);
+
+    index = self->symbols_length;
+    PyGILState_Release(gs);
+    return index;
+
+error:
+    Py_XDECREF(object);
+    PyGILState_Release(gs);
+    self->halt = 1;
+    return -1;
+}
+
+static void
+PySyckParser_mark_full(PySyckParserObject *self, long index)
+{
+    PySyckTreeNode *node = self->tree+index;
+    long k;
+
+    if (self->marks[index] == PYSYCK_FULL)
+        return;
+    self->marks[index] = PYSYCK_FULL;
+
+    if (node->kind == syck_str_kind)
+        return;
+
+    for (k = 0; k < node->length; k++) {
+        PySyckParser_mark_full(self, node->items[k]-1);
+        if (node->kind == syck_map_kind)
+            PySyckParser_mark_full(self, node->values[k]-1);
+    }
+}
+
+static void
+PySyckParser_mark_path(PySyckParserObject *self, long index,
+        PyObject *path, Py_ssize_t depth)
+{
+    PySyckTreeNode *node = self->tree+index;
+    PySyckTreeNode *key;
+    PyObject *component;
+    char buf[32];
+    long k;
+
+    if (depth == PyTuple_GET_SIZE(path)) {
+        PySyckParser_mark_full(self, index);
+        return;
+    }
+
+    /* A scalar cannot contain the rest of the path, so it is not built. */
+    if (node->kind == syck_str_kind)
         return;
+
+    if (self->marks[index] == PYSYCK_SKIP)
+        self->marks[index] = PYSYCK_PARTIAL;
+
+    component = PyTuple_GET_ITEM(path, depth);
+
+    switch (node->kind) {
+
+        case syck_seq_kind:
+            for (k = 0; k < node->length; k++) {
+                if (component != Py_None) {
+                    PyOS_snprintf(buf, sizeof(buf), "%ld", k);
+                    if (strcmp(buf, PyString_AS_STRING(component)) != 0)
+                        continue;
+                }
+                PySyckParser_mark_path(self, node->items[k]-1, path, depth+1);
+            }
+            break;
+
+        case syck_map_kind:
+            for (k = 0; k < node->length; k++) {
+                key = self->tree+node->items[k]-1;
+                if (key->kind != syck_str_kind)
+                    continue;
+                if (component != Py_None
+                        && (key->length != PyString_GET_SIZE(component)
+                            || memcmp(key->str, PyString_AS_STRING(component),
+                                key->length) != 0))
+                    continue;
+                PySyckParser_mark_path(self, node->values[k]-1, path, depth+1);
+                if (self->marks[node->values[k]-1] != PYSYCK_SKIP)
+                    PySyckParser_mark_full(self, node->items[k]-1);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static int
+PySyckParser_mark_tree(PySyckParserObject *self, long root)
+{
+    Py_ssize_t k;
+
+    self->marks = calloc(self->tree_length ? self->tree_length : 1, 1);
+    if (!self->marks) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (k = 0; k < PyTuple_GET_SIZE(self->select); k++)
+        PySyckParser_mark_path(self, root,
+                PyTuple_GET_ITEM(self->select, k), 0);
+
+    return 0;
+}
+
+/* Makes a view of the node that contains only the selected children. */
+
+static int
+PySyckParser_prune_node(PySyckParserObject *self, PySyckTreeNode *node,
+        PySyckTreeNode *view)
+{
+    long k;
+
+    *view = *node;
+    if (node->kind == syck_str_kind)
+        return 0;
+
+    view->items = malloc((node->length ? 2*node->length : 1)*sizeof(SYMID));
+    if (!view->items) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    view->values = view->items+node->length;
+    view->length = 0;
+
+    for (k = 0; k < node->length; k++) {
+        if (node->kind == syck_seq_kind) {
+            if (self->marks[node->items[k]-1] == PYSYCK_SKIP)
+                continue;
+        }
+        else {
+            if (self->marks[node->items[k]-1] == PYSYCK_SKIP
+                    || self->marks[node->values[k]-1] == PYSYCK_SKIP)
+                continue;
+            view->values[view->length] = node->values[k];
+        }
+        view->items[view->length++] = node->items[k];
+    }
+
+    return 0;
+}
+
+static int
+PySyckParser_build_tree(PySyckParserObject *self)
+{
+    long k;
+    PySyckTreeNode view;
+    PyObject *object;
+
+    for (k = 0; k < self->tree_length; k++) {
+        if (self->marks && self->marks[k] == PYSYCK_SKIP) {
+            if (PySyckParser_add_symbol(self, Py_None) < 0)
+                return -1;
+            continue;
+        }
+        if (self->marks && self->marks[k] == PYSYCK_PARTIAL) {
+            if (PySyckParser_prune_node(self, self->tree+k, &view) < 0)
+                return -1;
+            if (self->native)
+                object = PySyckParser_build_object(self, &view);
+            else
+                object = PySyckParser_build_node(self, &view);
+            if (view.kind != syck_str_kind)
+                free(view.items);
+        }
+        else if (self->native)
+            object = PySyckParser_build_object(self, self->tree+k);
+        else
+            object = PySyckParser_build_node(self, self->tree+k);
+        if (!object) return -1;
+        if (PySyckParser_add_symbol(self, object) < 0) {
+            Py_DECREF(object);
+            return -1;
+        }
+        Py_DECREF(object);
+    }
+
+    return 0;
+}
+
+static void
+PySyckParser_error_handler(SyckParser *parser, char *str)
+{
+    PyGILState_STATE gs;
+
+    PySyckParserObject *self = (PySyckParserObject *)parser->bonus;
+    PyObject *value;
+
+    if (self->halt) return;
+
+    self->halt = 1;
+
+    if (self->deferred) {
+        self->error = PYSYCK_SYNTAX_ERROR;
+        strncpy(self->error_message, str, PYSYCK_ERROR_MESSAGE_SIZE-1);
+        self->error_message[PYSYCK_ERROR_MESSAGE_SIZE-1] = '\0';
+        self->error_line = parser->linect;
+        self->error_column = parser->cursor - parser->lineptr;
+        return;
+    }
+
+    gs = PyGILState_Ensure();
+
+    value = Py_BuildValue("(sii)", str,
+            parser->linect, parser->cursor - parser->lineptr);
+    if (value) {
+        PyErr_SetObject(PySyck_Error, value);
+        Py_DECREF(value);
+    }
+
+    PyGILState_Release(gs);
+}
+
+SyckNode *
+PySyckParser_bad_anchor_handler(SyckParser *parser, char *anchor)
+{
+    PyGILState_STATE gs;
+
+    PySyckParserObject *self = (PySyckParserObject *)parser->bonus;
+
+    if (!self->halt) {
+        self->halt = 1;
+
+        if (self->deferred) {
+            self->error = PYSYCK_RECURSIVE_ERROR;
+        }
+        else {
+            gs = PyGILState_Ensure();
+            PyErr_SetString(PyExc_TypeError, "recursive anchors are not implemented");
+            PyGILState_Release(gs);
+        }
+    }
+
+    return syck_alloc_str();
+}
+
+static void
+PySyckParser_raise_error(PySyckParserObject *self)
+{
+    PyObject *value;
+
+    switch (self->error) {
+
+        case PYSYCK_SYNTAX_ERROR:
+            value = Py_BuildValue("(sii)", self->error_message,
+                    self->error_line, self->error_column);
+            if (value) {
+                PyErr_SetObject(PySyck_Error, value);
+                Py_DECREF(value);
+            }
+            break;
+
+        case PYSYCK_RECURSIVE_ERROR:
+            PyErr_SetString(PyExc_TypeError, "recursive anchors are not implemented");
+            break;
+
+        case PYSYCK_MEMORY_ERROR:
+            PyErr_NoMemory();
+            break;
+
+        case PYSYCK_IO_ERROR:
+            errno = self->error_errno;
+            PyErr_SetFromErrno(PyExc_IOError);
+            break;
+
+        case PYSYCK_BUFFER_ERROR:
+            PyErr_SetString(PyExc_ValueError, PYSYCK_BUFFER_ERROR_MESSAGE);
+            break;
+    }
+
+    self->error = PYSYCK_NO_ERROR;
+}
+
+static long
+PySyckParser_read_handler(char *buf, SyckIoFile *file, long max_size, long skip)
+{
+    PyGILState_STATE gs;
+
+    PySyckParserObject *self = (PySyckParserObject *)file->ptr;
+
+    PyObject *value;
+
+    char *str;
+    int length;
+
+    buf[skip] = '\0';
+
+    if (self->halt) {
+        return skip;
+    }
+
+    /* Syck asks for SYCK_BUFFERSIZE-1 bytes whatever the buffer size is. */
+    max_size = (long)self->parser->bufsize-1-skip;
+
+    gs = PyGILState_Ensure();
+
+    if (max_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, PYSYCK_BUFFER_ERROR_MESSAGE);
+        self->halt = 1;
+
+        PyGILState_Release(gs);
+
+        return skip;
+    }
+
+    value = PyObject_CallMethod(self->source, "read", "(i)", max_size);
+    if (!value) {
+        self->halt = 1;
+
+        PyGILState_Release(gs);
+
+        return skip;
+    }
+
+    if (!PyString_CheckExact(value)) {
+        Py_DECREF(value);
+        PyErr_SetString(PyExc_TypeError, "file-like object should return a string");
+        self->halt = 1;
+        
+        PyGILState_Release(gs);
+
+        return skip;
+    }
+
+    str = PyString_AS_STRING(value);
+    length = PyString_GET_SIZE(value);
+    if (!length) {
+        Py_DECREF(value);
+
+        PyGILState_Release(gs);
+
+        return skip;
+    }
+
+    if (length > max_size) {
+        Py_DECREF(value);
+        PyErr_SetString(PyExc_ValueError, "read returns an overly long string");
+        self->halt = 1;
+
+        PyGILState_Release(gs);
+
+        return skip;
+    }
+
+    memcpy(buf+skip, str, length);
+    length += skip;
+    buf[length] = '\0';
+
+    Py_DECREF(value);
+
+    PyGILState_Release(gs);
+
+    return length;
+}
+
+/* Reads a buffer source that cannot be held (mmap, array and so on) in place.
+ * The buffer may be resized or closed at any time, so its memory is looked up
+ * and copied with the GIL held, one chunk at a time. */
+
+static long
+PySyckParser_buffer_read_handler(char *buf, SyckIoFile *file, long max_size, long skip)
+{
+    PyGILState_STATE gs;
+
+    PySyckParserObject *self = (PySyckParserObject *)file->ptr;
+
+    const void *buffer;
+    Py_ssize_t length;
+
+    buf[skip] = '\0';
+
+    if (self->halt) {
+        return skip;
+    }
+
+    /* Syck asks for SYCK_BUFFERSIZE-1 bytes whatever the buffer size is. */
+    max_size = (long)self->parser->bufsize-1-skip;
+
+    gs = PyGILState_Ensure();
+
+    if (max_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, PYSYCK_BUFFER_ERROR_MESSAGE);
+        self->halt = 1;
+    }
+    else if (PyObject_AsReadBuffer(self->source, &buffer, &length) < 0) {
+        self->halt = 1;
+    }
+    else if (self->position > length) {
+        PyErr_SetString(PyExc_ValueError, "buffer source is truncated");
+        self->halt = 1;
+    }
+    else {
+        if (max_size > length-self->position)
+            max_size = length-self->position;
+        memcpy(buf+skip, (const char *)buffer+self->position, max_size);
+        self->position += max_size;
+        skip += max_size;
+        buf[skip] = '\0';
+    }
+
+    PyGILState_Release(gs);
+
+    return skip;
+}
+
+/* Reads a file or a file descriptor; called without the global lock. */
+
+static long
+PySyckParser_file_read_handler(char *buf, SyckIoFile *file, long max_size, long skip)
+{
+    PySyckParserObject *self = (PySyckParserObject *)file->ptr;
+
+    long length;
+
+    buf[skip] = '\0';
+
+    if (self->halt) {
+        return skip;
+    }
+
+    /* Syck asks for SYCK_BUFFERSIZE-1 bytes whatever the buffer size is. */
+    max_size = (long)self->parser->bufsize-1-skip;
+    if (max_size <= 0) {
+        self->error = PYSYCK_BUFFER_ERROR;
+        self->halt = 1;
+        return skip;
+    }
+
+    if (self->stream) {
+        length = fread(buf+skip, 1, max_size, self->stream);
+        if (!length && ferror(self->stream)) {
+            clearerr(self->stream);
+            length = -1;
+        }
+    }
+    else {
+        do {
+            length = read(self->fd, buf+skip, max_size);
+        } while (length < 0 && errno == EINTR);
+    }
+
+    if (length < 0) {
+        self->error = PYSYCK_IO_ERROR;
+        self->error_errno = errno;
+        self->halt = 1;
+        return skip;
+    }
+
+    length += skip;
+    buf[length] = '\0';
+
+    return length;
+}
+
+/* Converts 'a.*.b' or a list of such paths to (('a', None, 'b'), ...). */
+
+static PyObject *
+PySyck_parse_paths(PyObject *select)
+{
+    PyObject *strings;
+    PyObject *paths = NULL;
+    PyObject *path;
+    PyObject *item;
+    Py_ssize_t k, j;
+
+    if (PyString_Check(select))
+        strings = Py_BuildValue("(O)", select);
+    else
+        strings = PySequence_Tuple(select);
+    if (!strings) return NULL;
+
+    paths = PyTuple_New(PyTuple_GET_SIZE(strings));
+    if (!paths) goto error;
+
+    for (k = 0; k < PyTuple_GET_SIZE(strings); k++) {
+        item = PyTuple_GET_ITEM(strings, k);
+        if (!PyString_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "a path must be a string");
+            goto error;
+        }
+        if (PyString_GET_SIZE(item))
+            item = PyObject_CallMethod(item, "split", "(s)", ".");
+        else
+            item = PyList_New(0);
+        if (!item) goto error;
+        path = PyList_AsTuple(item);
+        Py_DECREF(item);
+        if (!path) goto error;
+        PyTuple_SET_ITEM(paths, k, path);
+        for (j = 0; j < PyTuple_GET_SIZE(path); j++) {
+            item = PyTuple_GET_ITEM(path, j);
+            if (strcmp(PyString_AS_STRING(item), "*") == 0) {
+                Py_DECREF(item);
+                Py_INCREF(Py_None);
+                PyTuple_SET_ITEM(path, j, Py_None);
+            }
+        }
+    }
+
+    Py_DECREF(strings);
+    return paths;
+
+error:
+    Py_DECREF(strings);
+    Py_XDECREF(paths);
+    return NULL;
+}
+
+static int
+PySyckParser_init(PySyckParserObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *source = NULL;
+    int implicit_typing = 1;
+    int taguri_expansion = 1;
+    int deferred = 0;
+    int bufsize = 0;
+    PyObject *select = NULL;
+    long offset = 0;
+    int pause_gc = 0;
+    int intern_keys = 0;
+    int dedup_scalars = 0;
+    const void *buffer;
+    Py_ssize_t length;
+    int held;
+
+    static char *kwdlist[] = {"source", "implicit_typing", "taguri_expansion",
+        "deferred", "bufsize", "select", "offset", "pause_gc",
+        "intern_keys", "dedup_scalars", NULL};
+
+    PySyckParser_clear(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiiOliii", kwdlist,
+                &source, &implicit_typing, &taguri_expansion, &deferred,
+                &bufsize, &select, &offset, &pause_gc,
+                &intern_keys, &dedup_scalars))
+        return -1;
+
+    if (select && select != Py_None) {
+        self->select = PySyck_parse_paths(select);
+        if (!self->select)
+            return -1;
+        deferred = 1;
+    }
+
+    if (PyInt_CheckExact(source) && PyInt_AS_LONG(source) < 0) {
+        PyErr_SetString(PyExc_ValueError, "negative file descriptor");
+        return -1;
+    }
+
+    Py_INCREF(source);
+    self->source = source;
+
+    self->implicit_typing = implicit_typing;
+    self->taguri_expansion = taguri_expansion;
+    self->deferred = deferred;
+    self->bufsize = bufsize;
+    self->pause_gc = pause_gc;
+    self->intern_keys = intern_keys;
+    self->dedup_scalars = dedup_scalars;
+    self->documents = 0;
+    self->nodes = 0;
+    self->collections_avoided = 0;
+    self->error = PYSYCK_NO_ERROR;
+    self->stream = NULL;
+    self->fd = -1;
+
+    if (dedup_scalars) {
+        self->scalars = calloc(PYSYCK_SCALAR_CACHE_SIZE, sizeof(PyObject *));
+        if (!self->scalars) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+
+    self->parser = syck_new_parser();
+    self->parser->bonus = self;
+    if (self->bufsize > 0)
+        self->parser->bufsize = self->bufsize;
+
+    if (PyString_CheckExact(self->source)) {
+        if (offset < 0 || offset > PyString_GET_SIZE(self->source))
+            goto bad_offset;
+        /* Syck's string reader always fills SYCK_BUFFERSIZE-1 bytes. */
+        if (self->parser->bufsize < SYCK_BUFFERSIZE)
+            self->parser->bufsize = SYCK_BUFFERSIZE;
+        syck_parser_str(self->parser,
+                PyString_AS_STRING(self->source)+offset,
+                PyString_GET_SIZE(self->source)-offset, NULL);
+    }
+    /*
+    else if (PyUnicode_CheckExact(self->source)) {
+        syck_parser_str(self->parser,
+                PyUnicode_AS_DATA(self->source),
+                PyString_GET_DATA_SIZE(self->source), NULL);
+    }
+    */
+    else if (!PyUnicode_Check(self->source)
+            && PyObject_CheckReadBuffer(self->source)) {
+        held = PySyckParser_hold_source(self, &buffer, &length);
+        if (held < 0)
+            return -1;
+        if (!held && PyObject_AsReadBuffer(self->source, &buffer, &length) < 0)
+            return -1;
+        if (offset < 0 || offset > length)
+            goto bad_offset;
+        if (held) {
+            if (self->parser->bufsize < SYCK_BUFFERSIZE)
+                self->parser->bufsize = SYCK_BUFFERSIZE;
+            syck_parser_str(self->parser, (char *)buffer+offset,
+                    length-offset, NULL);
+        }
+        else {
+            self->position = offset;
+            syck_parser_file(self->parser, (FILE *)self,
+                    PySyckParser_buffer_read_handler);
+        }
+    }
+    else if (offset) {
+        PyErr_SetString(PyExc_ValueError,
+                "offset requires a string or a buffer source");
+        return -1;
+    }
+    /* A file opened in the universal newline mode is read by its method
+     * read(), which translates the newlines; fread() would not. */
+    else if (PyFile_Check(self->source)
+            && !((PyFileObject *)self->source)->f_univ_newline) {
+        self->stream = PyFile_AsFile(self->source);
+        if (!self->stream) {
+            PyErr_SetString(PyExc_ValueError, "I/O operation on closed file");
+            return -1;
+        }
+        syck_parser_file(self->parser, (FILE *)self,
+                PySyckParser_file_read_handler);
+    }
+    else if (PyInt_CheckExact(self->source)) {
+        self->fd = PyInt_AS_LONG(self->source);
+        syck_parser_file(self->parser, (FILE *)self,
+                PySyckParser_file_read_handler);
+    }
+    else {
+        syck_parser_file(self->parser, (FILE *)self, PySyckParser_read_handler);
+    }
+
+    syck_parser_implicit_typing(self->parser, self->implicit_typing);
+    syck_parser_taguri_expansion(self->parser, self->taguri_expansion);
+
+    syck_parser_handler(self->parser, PySyckParser_node_handler);
+    syck_parser_error_handler(self->parser, PySyckParser_error_handler);
+    syck_parser_bad_anchor_handler(self->parser, PySyckParser_bad_anchor_handler);
+
+    self->parsing = 0;
+    self->halt = 0;
+
+    return 0;
+
+bad_offset:
+    PyErr_SetString(PyExc_ValueError, "offset is out of range");
+    return -1;
+}
+
+/* Pausing the cyclic GC while a document is parsed. */
+
+static PyObject *PySyck_GCModule = NULL;
+
+/* Returns the first item of gc.get_count() or gc.get_threshold(), or -1. */
+
+static long
+PySyck_gc_generation0(char *method)
+{
+    PyObject *result;
+    PyObject *item;
+    long value = -1;
+
+    result = PyObject_CallMethod(PySyck_GCModule, method, NULL);
+    if (!result) {
+        PyErr_Clear();
+        return -1;
+    }
+    item = PySequence_GetItem(result, 0);
+    Py_DECREF(result);
+    if (item) {
+        value = PyInt_AsLong(item);
+        Py_DECREF(item);
+    }
+    if (PyErr_Occurred()) {
+        PyErr_Clear();
+        return -1;
+    }
+    return value;
+}
+
+static int
+PySyckParser_pause_gc(PySyckParserObject *self)
+{
+    PyObject *result;
+    int enabled;
+
+    if (!PySyck_GCModule) {
+        PySyck_GCModule = PyImport_ImportModule("gc");
+        if (!PySyck_GCModule) return -1;
+    }
+
+    result = PyObject_CallMethod(PySyck_GCModule, "isenabled", NULL);
+    if (!result) return -1;
+    enabled = PyObject_IsTrue(result);
+    Py_DECREF(result);
+    if (enabled <= 0)
+        return enabled;
+
+    result = PyObject_CallMethod(PySyck_GCModule, "disable", NULL);
+    if (!result) return -1;
+    Py_DECREF(result);
+
+    self->gc_paused = 1;
+    self->gc_count = PySyck_gc_generation0("get_count");
+    return 0;
+}
+
+static void
+PySyckParser_resume_gc(PySyckParserObject *self)
+{
+    PyObject *type, *value, *traceback;
+    PyObject *result;
+    long count, threshold;
+
+    if (!self->gc_paused)
+        return;
+    self->gc_paused = 0;
+
+    PyErr_Fetch(&type, &value, &traceback);
+
+    /* The allocations counted since the GC was paused tell how many
+     * generation 0 collections would have run (gc.get_count() is 2.5+). */
+    count = PySyck_gc_generation0("get_count");
+    threshold = PySyck_gc_generation0("get_threshold");
+    if (self->gc_count >= 0 && count > self->gc_count && threshold > 0)
+        self->collections_avoided += (count-self->gc_count)/threshold;
+
+    result = PyObject_CallMethod(PySyck_GCModule, "enable", NULL);
+    if (result)
+        Py_DECREF(result);
+    else
+        PyErr_Clear();
+
+    PyErr_Restore(type, value, traceback);
+}
+
+static PyObject *
+PySyckParser_parse(PySyckParserObject *self)
+{
+    SYMID index;
+    PyObject *value;
+
+    if (self->parsing) {
+        PyErr_SetString(PyExc_RuntimeError,
+                "do not call Parser.parse while it is already running");
+        return NULL;
+    }
+
+    if (self->halt) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    if (self->stream) {
+        /* The file may be closed since the last call. */
+        self->stream = PyFile_AsFile(self->source);
+        if (!self->stream) {
+            PyErr_SetString(PyExc_ValueError, "I/O operation on closed file");
+            return NULL;
+        }
+    }
+
+    if (self->pause_gc && PySyckParser_pause_gc(self) < 0)
+        return NULL;
+
+    self->parsing = 1;
+#if PY_VERSION_HEX >= 0x02060000
+    if (self->stream)
+        PyFile_IncUseCount((PyFileObject *)self->source);
+#endif
+    Py_BEGIN_ALLOW_THREADS
+    index = syck_parse(self->parser)-1;
+    Py_END_ALLOW_THREADS
+#if PY_VERSION_HEX >= 0x02060000
+    if (self->stream)
+        PyFile_DecUseCount((PyFileObject *)self->source);
+#endif
+
+    if (self->deferred) {
+        if (!self->halt && !self->parser->eof
+                && ((self->select && PySyckParser_mark_tree(self, index) < 0)
+                    || PySyckParser_build_tree(self) < 0))
+            self->halt = 1;
+        free(self->marks);
+        self->marks = NULL;
+        PySyckParser_clear_tree(self);
+    }
+    if (self->error)
+        PySyckParser_raise_error(self);
+    self->parsing = 0;
+
+    if (self->halt || self->parser->eof) {
+        PySyckParser_clear_symbols(self);
+        PySyckParser_resume_gc(self);
+        PySyckParser_release_source(self);
+
+        if (self->halt) return NULL;
+
+        self->halt = 1;
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    if (self->events) {
+        value = PyInt_FromLong(index+1);
+    }
+    else {
+        value = PySyckParser_get_symbol(self, index);
+        Py_XINCREF(value);
+    }
+
+    PySyckParser_clear_symbols(self);
+    PySyckParser_resume_gc(self);
+
+    if (value)
+        self->documents++;
+
+    return value;
+}
+
+PyDoc_STRVAR(PySyckParser_parse_doc,
+    "parse() -> the root Node object\n\n"
+    "Parses the source and returns the root of the Node tree. Call it\n"
+    "several times to retrieve all documents from the source. On EOF,\n"
+    "returns None and sets the 'eof' attribute on.\n");
+
+static PyObject *
+PySyckParser_load_native(PySyckParserObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *types = NULL;
+    PyObject *value;
+    long mask;
+
+    static char *kwdlist[] = {"types", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwdlist, &types))
+        return NULL;
+
+    if (self->parsing) {
+        PyErr_SetString(PyExc_RuntimeError,
+                "do not call Parser.load_native while it is already running");
+        return NULL;
+    }
+
+    mask = PySyck_core_types_mask(types);
+    if (mask < 0) return NULL;
+
+    self->construct = PyObject_GetAttrString((PyObject *)self, "construct");
+    if (!self->construct) {
+        if (!PyErr_ExceptionMatches(PyExc_AttributeError))
+            return NULL;
+        PyErr_Clear();
+    }
+
+    self->native = 1;
+    self->native_types = mask;
+
+    value = PySyckParser_parse(self);
+
+    self->native = 0;
+    Py_XDECREF(self->construct);
+    self->construct = NULL;
+
+    return value;
+}
+
+PyDoc_STRVAR(PySyckParser_load_native_doc,
+    "load_native(types=None) -> the root object\n\n"
+    "Parses the source and builds Python objects directly, skipping the\n"
+    "Node tree. Nodes of the core YAML types listed in 'types' (all of\n"
+    "them if None) are converted to strings, numbers, booleans, None,\n"
+    "lists and dictionaries in C. Other nodes are passed to the method\n"
+    "'construct' if it is defined. On EOF, returns None and sets the\n"
+    "'eof' attribute on.\n");
+
+static PyObject *
+PySyckParser_parse_events(PySyckParserObject *self, PyObject *args)
+{
+    PyObject *callback;
+    PyObject *value;
+
+    if (!PyArg_ParseTuple(args, "O", &callback))
+        return NULL;
+
+    if (self->parsing) {
+        PyErr_SetString(PyExc_RuntimeError,
+                "do not call Parser.parse_events while it is already running");
+        return NULL;
+    }
+
+    /* Events are reported as Syck produces them, before a path is known. */
+    if (self->select) {
+        PyErr_SetString(PyExc_ValueError,
+                "parse_events does not support 'select'");
+        return NULL;
+    }
+
+    Py_INCREF(callback);
+    self->events = callback;
+    self->events_count = 0;
+
+    value = PySyckParser_parse(self);
+
+    Py_XDECREF(self->events);
+    self->events = NULL;
+
+    return value;
+}
+
+PyDoc_STRVAR(PySyckParser_parse_events_doc,
+    "parse_events(callback) -> the id of the root node\n\n"
+    "Parses a document without building a tree. For each node, calls\n"
+    "callback(kind, id, tag, anchor, value) as soon as Syck produces it.\n"
+    "Syck reports children before their collection, so the value of a\n"
+    "scalar is a string, the value of a sequence is a tuple of item ids,\n"
+    "and the value of a mapping is a tuple of (key id, value id) pairs.\n"
+    "An anchored node is reported once; its aliases reuse its id. If the\n"
+    "callback raises an exception, parsing stops and the exception is\n"
+    "propagated. On EOF, returns None and sets the 'eof' attribute on.\n");
+
+static PyMethodDef PySyckParser_methods[] = {
+    {"parse",  (PyCFunction)PySyckParser_parse,
+        METH_NOARGS, PySyckParser_parse_doc},
+    {"load_native",  (PyCFunction)PySyckParser_load_native,
+        METH_VARARGS|METH_KEYWORDS, PySyckParser_load_native_doc},
+    {"parse_events",  (PyCFunction)PySyckParser_parse_events,
+        METH_VARARGS, PySyckParser_parse_events_doc},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject PySyckParser_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                          /* ob_size */
+    "_syck.Parser",                             /* tp_name */
+    sizeof(PySyckParserObject),                 /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)PySyckParser_dealloc,           /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_compare */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE|Py_TPFLAGS_HAVE_GC,  /* tp_flags */
+    PySyckParser_doc,                           /* tp_doc */
+    (traverseproc)PySyckParser_traverse,        /* tp_traverse */
+    (inquiry)PySyckParser_clear,                /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    0,                                          /* tp_iter */
+    0,                                          /* tp_iternext */
+    PySyckParser_methods,                       /* tp_methods */
+    0,                                          /* tp_members */
+    PySyckParser_getsetters,                    /* tp_getset */
+    0,                                          /* tp_base */
+    0,                                          /* tp_dict */
+    0,                                          /* tp_descr_get */
+    0,                                          /* tp_descr_set */
+    0,                                          /* tp_dictoffset */
+    (initproc)PySyckParser_init,                /* tp_init */
+    0,                                          /* tp_alloc */
+    PySyckParser_new,                           /* tp_new */
+};
+
+/****************************************************************************
+ * The type _syck.Emitter.
+ ****************************************************************************/
+
+PyDoc_STRVAR(PySyckEmitter_doc,
+    "Emitter(output, headless=False, use_header=False, use_version=False,\n"
+    "        explicit_typing=True, style=None, best_width=80, indent=2,\n"
+    "        bufsize=65536, offset=0) -> an Emitter object\n\n"
+    "_syck.Emitter is a low-lever wrapper of the Syck emitter. It emits\n"
+    "a tree of Nodes into a YAML stream.\n\n"
+    "The output is collected into blocks of 'bufsize' bytes before it is\n"
+    "written to 'output'. If 'output' is None, the whole stream is kept\n"
+    "and returned by 'getvalue()'. If 'output' is an integer file\n"
+    "descriptor, the blocks are written without holding the GIL. If\n"
+    "'output' is a writable buffer (such as mmap or array), the stream is\n"
+    "written into it in place starting at 'offset'.\n");
+
+#define PySyck_CheckWriteBuffer(object)                 \
+    ((object)->ob_type->tp_as_buffer                    \
+     && (object)->ob_type->tp_as_buffer->bf_getwritebuffer)
+
+/* The default size of the blocks passed to output.write(). */
+
+#define PYSYCK_BUFFER_SIZE  65536
+
+/* Builtin types emitted by Emitter.dump_native() without creating Nodes. */
+
+enum {
+    PYSYCK_DUMP_NONE,
+    PYSYCK_DUMP_BOOL,
+    PYSYCK_DUMP_INT,
+    PYSYCK_DUMP_LONG,
+    PYSYCK_DUMP_FLOAT,
+    PYSYCK_DUMP_STR,
+    PYSYCK_DUMP_UNICODE,
+    PYSYCK_DUMP_LIST,
+    PYSYCK_DUMP_TUPLE,
+    PYSYCK_DUMP_DICT,
+    PYSYCK_DUMP_TYPES,      /* the number of builtin types */
+    PYSYCK_DUMP_OTHER = -1  /* not a builtin type, use Dumper.represent() */
+};
+
+/* An entry of the table mapping marked objects to their symbols. */
+
+typedef struct {
+    PyObject *object;       /* NULL if the entry is free */
+    long symbol;
+} PySyckMark;
+
+/* The Dumper representer of a type is 'represent_'+name. */
+
+static char *PySyck_DumpTypes[PYSYCK_DUMP_TYPES] = {
+    "NoneType", "bool", "int", "long", "float",
+    "str", "unicode", "list", "tuple", "dict"
+};
+
+#define PYSYCK_ALL_DUMP_TYPES   ((1L << PYSYCK_DUMP_TYPES) - 1)
+
+typedef struct {
+    PyObject_HEAD
+    /* Attributes: */
+    PyObject *output;       /* a file-like object */
+    int headless;
+    int use_header;
+    int use_version;
+    int explicit_typing;
+    enum scalar_style style;
+    int best_width;
+    int indent;
+    long bufsize;
+    long position;          /* the end of the output in a buffer output */
+    /* Internal fields: */
+    int fd;                 /* the output file descriptor or -1 */
+    int in_place;           /* the output is a writable buffer */
+    char *target;           /* the buffer output if it is held */
+    long target_length;
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    Py_buffer view;         /* holds 'target' while a document is emitted */
+#endif
+    char *buffer;           /* the output not written yet */
+    long buffer_length;
+    long buffer_capacity;
+    long buffer_start;      /* where the current document starts in buffer */
+    PyObject **symbols;     /* symbol table, the marked nodes or objects */
+    long symbols_length;    /* the number of symbols, 0 outside emit() */
+    long symbols_capacity;  /* the tables are kept between emit() calls */
+    PySyckMark *marks;      /* object -> symbol, an open addressing table */
+    long marks_length;
+    long marks_capacity;    /* a power of 2 */
+    SyckEmitter *emitter;
+    int emitting;
+    int halt;
+    int native;             /* emit Python objects instead of Nodes */
+    long native_types;      /* builtin types emitted in C, a mask */
+    PyObject *represent;    /* self.represent, NULL outside dump_native() */
+    PyObject *objects;      /* represented objects, kept alive while dumping */
+    long *items;            /* the child symbols of all collections */
+    long items_length;
+    long items_capacity;
+    long *offsets;          /* symbol -> the index of its first child */
+    long offsets_capacity;
+} PySyckEmitterObject;
+
+static PyObject *
+PySyckEmitter_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PySyckEmitterObject *self;
+
+    self = (PySyckEmitterObject *)type->tp_alloc(type, 0);
+    if (!self) return NULL;
+
+    self->output = NULL;
+    self->headless = 0;
+    self->use_header = 0;
+    self->use_version = 0;
+    self->explicit_typing = 0;
+    self->style = scalar_none;
+    self->best_width = 0;
+    self->indent = 0;
+    self->bufsize = PYSYCK_BUFFER_SIZE;
+    self->position = 0;
+    self->fd = -1;
+    self->in_place = 0;
+    self->target = NULL;
+    self->target_length = 0;
+    self->buffer = NULL;
+    self->buffer_length = 0;
+    self->buffer_capacity = 0;
+    self->buffer_start = 0;
+    self->symbols = NULL;
+    self->symbols_length = 0;
+    self->symbols_capacity = 0;
+    self->marks = NULL;
+    self->marks_length = 0;
+    self->marks_capacity = 0;
+    self->emitter = NULL;
+    self->emitting = 0;
+    self->halt = 1;
+    self->native = 0;
+    self->native_types = 0;
+    self->represent = NULL;
+    self->objects = NULL;
+    self->items = NULL;
+    self->items_length = 0;
+    self->items_capacity = 0;
+    self->offsets = NULL;
+    self->offsets_capacity = 0;
+
+    return (PyObject *)self;
+}
+
+static void
+PySyckEmitter_clear_symbols(PySyckEmitterObject *self)
+{
+    PyObject *object;
+
+    while (self->symbols_length > 0) {
+        object = self->symbols[--self->symbols_length];
+        Py_DECREF(object);
+    }
+
+    if (self->marks_length > 0) {
+        memset(self->marks, 0, self->marks_capacity*sizeof(PySyckMark));
+        self->marks_length = 0;
+    }
+}
+
+static int
+PySyckEmitter_clear(PySyckEmitterObject *self)
+{
+    PyObject *tmp;
+
+    if (self->emitter) {
+        syck_free_emitter(self->emitter);
+        self->emitter = NULL;
+    }
+
+    tmp = self->output;
+    self->output = NULL;
+    Py_XDECREF(tmp);
+
+    self->fd = -1;
+    self->in_place = 0;
+    self->target = NULL;
+    self->target_length = 0;
+
+    free(self->buffer);
+    self->buffer = NULL;
+    self->buffer_length = 0;
+    self->buffer_capacity = 0;
+    self->buffer_start = 0;
+
+    PySyckEmitter_clear_symbols(self);
+    free(self->symbols);
+    self->symbols = NULL;
+    self->symbols_capacity = 0;
+
+    free(self->marks);
+    self->marks = NULL;
+    self->marks_length = 0;
+    self->marks_capacity = 0;
+
+    tmp = self->represent;
+    self->represent = NULL;
+    Py_XDECREF(tmp);
+
+    tmp = self->objects;
+    self->objects = NULL;
+    Py_XDECREF(tmp);
+
+    free(self->items);
+    self->items = NULL;
+    self->items_capacity = 0;
+    free(self->offsets);
+    self->offsets = NULL;
+    self->offsets_capacity = 0;
+
+    return 0;
+}
+
+static int
+PySyckEmitter_traverse(PySyckEmitterObject *self, visitproc visit, void *arg)
+{
+    long k;
+    int ret;
+
+    if (self->output)
+        if ((ret = visit(self->output, arg)) != 0)
+            return ret;
+
+    for (k = 0; k < self->symbols_length; k++)
+        if ((ret = visit(self->symbols[k], arg)) != 0)
+            return ret;
+
+    if (self->represent)
+        if ((ret = visit(self->represent, arg)) != 0)
+            return ret;
+
+    if (self->objects)
+        if ((ret = visit(self->objects, arg)) != 0)
+            return ret;
+
+    return 0;
+}
+
+static void
+PySyckEmitter_dealloc(PySyckEmitterObject *self)
+{
+    PySyckEmitter_clear(self);
+    self->ob_type->tp_free((PyObject *)self);
+}
+
+static PyObject *
+PySyckEmitter_getoutput(PySyckEmitterObject *self, void *closure)
+{
+    PyObject *value = self->output ? self->output : Py_None;
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckEmitter_getheadless(PySyckEmitterObject *self, void *closure)
+{
+    PyObject *value = self->headless ? Py_True : Py_False;
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckEmitter_getuse_header(PySyckEmitterObject *self, void *closure)
+{
+    PyObject *value = self->use_header ? Py_True : Py_False;
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckEmitter_getuse_version(PySyckEmitterObject *self, void *closure)
+{
+    PyObject *value = self->use_version ? Py_True : Py_False;
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckEmitter_getexplicit_typing(PySyckEmitterObject *self, void *closure)
+{
+    PyObject *value = self->explicit_typing ? Py_True : Py_False;
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckEmitter_getstyle(PySyckEmitterObject *self, void *closure)
+{
+    PyObject *value;
+
+    switch (self->style) {
+        case scalar_1quote: value = PySyck_1QuoteStyle; break;
+        case scalar_2quote: value = PySyck_2QuoteStyle; break;
+        case scalar_fold: value = PySyck_FoldStyle; break;
+        case scalar_literal: value = PySyck_LiteralStyle; break;
+        case scalar_plain: value = PySyck_PlainStyle; break;
+        default: value = Py_None;
+    }
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject *
+PySyckEmitter_getbest_width(PySyckEmitterObject *self, void *closure)
+{
+    return PyInt_FromLong(self->best_width);
+}
+
+static PyObject *
+PySyckEmitter_getindent(PySyckEmitterObject *self, void *closure)
+{
+    return PyInt_FromLong(self->indent);
+}
+
+static PyObject *
+PySyckEmitter_getbufsize(PySyckEmitterObject *self, void *closure)
+{
+    return PyInt_FromLong(self->bufsize);
+}
+
+static PyObject *
+PySyckEmitter_getposition(PySyckEmitterObject *self, void *closure)
+{
+    return PyInt_FromLong(self->position);
+}
+
+static PyGetSetDef PySyckEmitter_getsetters[] = {
+    {"output", (getter)PySyckEmitter_getoutput, NULL,
+        PyDoc_STR("output stream, a file-like object, a file descriptor, a buffer or None"), NULL},
+    {"headless", (getter)PySyckEmitter_getheadless, NULL,
+        PyDoc_STR("headerless document flag"), NULL},
+    {"use_header", (getter)PySyckEmitter_getuse_header, NULL,
+        PyDoc_STR("force header flag"), NULL},
+    {"use_version", (getter)PySyckEmitter_getuse_version, NULL,
+        PyDoc_STR("force version flag"), NULL},
+    {"explicit_typing", (getter)PySyckEmitter_getexplicit_typing, NULL,
+        PyDoc_STR("explicit typing for all collections"), NULL},
+    {"style", (getter)PySyckEmitter_getstyle, NULL,
+        PyDoc_STR("use literal or folded blocks on all text"), NULL},
+    {"best_width", (getter)PySyckEmitter_getbest_width, NULL,
+        PyDoc_STR("best width for folded scalars"), NULL},
+    {"indent", (getter)PySyckEmitter_getindent, NULL,
+        PyDoc_STR("default indentation"), NULL},
+    {"bufsize", (getter)PySyckEmitter_getbufsize, NULL,
+        PyDoc_STR("size of the blocks written to the output"), NULL},
+    {"position", (getter)PySyckEmitter_getposition, NULL,
+        PyDoc_STR("end of the output in a buffer output"), NULL},
+    {NULL}  /* Sentinel */
+};
+
+static long
+PySyck_dump_types_mask(PyObject *names)
+{
+    PyObject *iterator, *name;
+    long mask = 0;
+    char *str;
+    int k;
+
+    if (!names || names == Py_None)
+        return PYSYCK_ALL_DUMP_TYPES;
+
+    iterator = PyObject_GetIter(names);
+    if (!iterator) return -1;
+
+    while ((name = PyIter_Next(iterator))) {
+        if (!PyString_Check(name)) {
+            PyErr_SetString(PyExc_TypeError, "type names must be strings");
+            Py_DECREF(name);
+            Py_DECREF(iterator);
+            return -1;
+        }
+        str = PyString_AS_STRING(name);
+        for (k = 0; k < PYSYCK_DUMP_TYPES; k++)
+            if (strcmp(str, PySyck_DumpTypes[k]) == 0)
+                mask |= 1L << k;
+        Py_DECREF(name);
+    }
+
+    Py_DECREF(iterator);
+    if (PyErr_Occurred()) return -1;
+
+    return mask;
+}
+
+/* Checks whether an object may be aliased, like Dumper.allow_aliases(). */
+
+static int
+PySyck_allow_aliases(PyObject *object)
+{
+    char *str;
+    Py_ssize_t len, k;
+
+    if (object == Py_None || PyInt_CheckExact(object) || PyBool_Check(object)
+            || PyFloat_CheckExact(object))
+        return 0;
+
+    if (PyString_CheckExact(object)) {
+        str = PyString_AS_STRING(object);
+        len = PyString_GET_SIZE(object);
+        for (k = 0; k < len; k++)
+            if (!isalnum(Py_CHARMASK(str[k])))
+                return 1;
+        return 0;
+    }
+
+    if (PyTuple_CheckExact(object) && PyTuple_GET_SIZE(object) == 0)
+        return 0;
+
+    return 1;
+}
+
+/* Returns the builtin type of an object if it is emitted in C, or
+ * PYSYCK_DUMP_OTHER. A string that is not UTF-8 is left to
+ * Dumper.represent_str(), which emits it as binary. */
+
+static int
+PySyckEmitter_find_type(PySyckEmitterObject *self, PyObject *object)
+{
+    PyObject *value;
+    int type;
+
+    if (object == Py_None)
+        type = PYSYCK_DUMP_NONE;
+    else if (PyBool_Check(object))
+        type = PYSYCK_DUMP_BOOL;
+    else if (PyInt_CheckExact(object))
+        type = PYSYCK_DUMP_INT;
+    else if (PyLong_CheckExact(object))
+        type = PYSYCK_DUMP_LONG;
+    else if (PyFloat_CheckExact(object))
+        type = PYSYCK_DUMP_FLOAT;
+    else if (PyString_CheckExact(object))
+        type = PYSYCK_DUMP_STR;
+    else if (PyUnicode_CheckExact(object))
+        type = PYSYCK_DUMP_UNICODE;
+    else if (PyList_CheckExact(object))
+        type = PYSYCK_DUMP_LIST;
+    else if (PyTuple_CheckExact(object))
+        type = PYSYCK_DUMP_TUPLE;
+    else if (PyDict_CheckExact(object))
+        type = PYSYCK_DUMP_DICT;
+    else
+        return PYSYCK_DUMP_OTHER;
+
+    if (!(self->native_types & (1L << type)))
+        return PYSYCK_DUMP_OTHER;
+
+    if (type == PYSYCK_DUMP_STR && !PySyck_is_ascii(PyString_AS_STRING(object),
+                PyString_GET_SIZE(object))) {
+        value = PyUnicode_DecodeUTF8(PyString_AS_STRING(object),
+                PyString_GET_SIZE(object), "strict");
+        if (!value) {
+            PyErr_Clear();
+            return PYSYCK_DUMP_OTHER;
+        }
+        Py_DECREF(value);
+    }
+
+    return type;
+}
+
+static int
+PySyckEmitter_add_item(PySyckEmitterObject *self, long symbol)
+{
+    long *items;
+    long capacity;
+
+    if (self->items_length == self->items_capacity) {
+        capacity = self->items_capacity ? 2*self->items_capacity : 64;
+        items = realloc(self->items, capacity*sizeof(long));
+        if (!items) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->items = items;
+        self->items_capacity = capacity;
+    }
+    self->items[self->items_length++] = symbol;
+    return 0;
+}
+
+/* Records that the children of 'symbol' start at the current item. */
+
+static int
+PySyckEmitter_set_offset(PySyckEmitterObject *self, long symbol)
+{
+    long *offsets;
+    long capacity;
+
+    if (symbol >= self->offsets_capacity) {
+        capacity = self->offsets_capacity ? 2*self->offsets_capacity : 64;
+        offsets = realloc(self->offsets, capacity*sizeof(long));
+        if (!offsets) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->offsets = offsets;
+        self->offsets_capacity = capacity;
+    }
+    self->offsets[symbol] = self->items_length;
+    return 0;
+}
+
+static int
+PySyckEmitter_add_symbol(PySyckEmitterObject *self, PyObject *object)
+{
+    PyObject **symbols;
+    long capacity;
+
+    if (self->symbols_length == self->symbols_capacity) {
+        capacity = self->symbols_capacity ? 2*self->symbols_capacity : 64;
+        symbols = realloc(self->symbols, capacity*sizeof(PyObject *));
+        if (!symbols) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->symbols = symbols;
+        self->symbols_capacity = capacity;
     }
+    Py_INCREF(object);
+    self->symbols[self->symbols_length++] = object;
+    return 0;
+}
 
-    if (node->tag) {
-        tag = PyString_AsString(node->tag);
-        if (!tag) {
-            self->halt = 1;
-            PyGILState_Release(gs);
-            return;
+/* The marks table is keyed by object identity. Objects are aligned, so the
+ * low bits of their addresses are dropped. */
+
+#define PYSYCK_MARK_HASH(object)    ((size_t)(object) >> 4)
+
+static long
+PySyckEmitter_find_mark(PySyckEmitterObject *self, PyObject *object)
+{
+    size_t mask, k;
+
+    if (!self->marks_length)
+        return -1;
+
+    mask = self->marks_capacity-1;
+    for (k = PYSYCK_MARK_HASH(object) & mask; self->marks[k].object;
+            k = (k+1) & mask)
+        if (self->marks[k].object == object)
+            return self->marks[k].symbol;
+
+    return -1;
+}
+
+static void
+PySyckEmitter_insert_mark(PySyckMark *marks, long capacity,
+        PyObject *object, long symbol)
+{
+    size_t mask = capacity-1;
+    size_t k;
+
+    for (k = PYSYCK_MARK_HASH(object) & mask; marks[k].object;
+            k = (k+1) & mask);
+    marks[k].object = object;
+    marks[k].symbol = symbol;
+}
+
+static int
+PySyckEmitter_add_mark(PySyckEmitterObject *self, PyObject *object,
+        long symbol)
+{
+    PySyckMark *marks;
+    long capacity, k;
+
+    /* Keep the table at most half full. */
+    if (2*(self->marks_length+1) > self->marks_capacity) {
+        capacity = self->marks_capacity ? 2*self->marks_capacity : 64;
+        marks = calloc(capacity, sizeof(PySyckMark));
+        if (!marks) {
+            PyErr_NoMemory();
+            return -1;
         }
+        for (k = 0; k < self->marks_capacity; k++)
+            if (self->marks[k].object)
+                PySyckEmitter_insert_mark(marks, capacity,
+                        self->marks[k].object, self->marks[k].symbol);
+        free(self->marks);
+        self->marks = marks;
+        self->marks_capacity = capacity;
     }
 
-    if (PyObject_TypeCheck((PyObject *)node, &PySyckSeq_Type)) {
+    PySyckEmitter_insert_mark(self->marks, self->marks_capacity,
+            object, symbol);
+    self->marks_length++;
+    return 0;
+}
 
-        syck_emit_seq(emitter, tag, ((PySyckSeqObject *)node)->style);
+/* Marks an object and returns its symbol. Nodes and objects that may be
+ * aliased get one symbol; in the native mode, like GenericDumper._convert(),
+ * other objects get a new symbol for each occurrence, and objects of other
+ * than the builtin types are replaced with the Nodes returned by
+ * 'represent'. */
 
-        if (!PyList_Check(node->value)) {
-            PyErr_SetString(PyExc_TypeError, "value of _syck.Seq must be a list");
-            self->halt = 1;
-            PyGILState_Release(gs);
-            return;
+static long
+PySyckEmitter_mark_object(PySyckEmitterObject *self, PyObject *object)
+{
+    PyObject *node;
+    long symbol;
+    int alias;
+
+    alias = self->native ? PySyck_allow_aliases(object) : 1;
+    if (alias && (symbol = PySyckEmitter_find_mark(self, object)) >= 0) {
+        syck_emitter_mark_node(self->emitter, symbol);
+        return symbol;
+    }
+
+    if (!self->native
+            || PySyckEmitter_find_type(self, object) != PYSYCK_DUMP_OTHER) {
+        Py_INCREF(object);
+        node = object;
+    }
+    else {
+        if (!self->represent) {
+            PyErr_SetString(PyExc_TypeError, "cannot dump object");
+            return -1;
         }
-        l = PyList_GET_SIZE(node->value);
-        for (k = 0; k < l; k ++) {
-            item = PyList_GET_ITEM(node->value, k);
-            if ((index = PyDict_GetItem(self->nodes, item))) {
-                syck_emit_item(emitter, PyInt_AS_LONG(index));
-                if (self->halt) {
-                    PyGILState_Release(gs);
-                    return;
-                }
-            }
-            else {
-                PyErr_SetString(PyExc_RuntimeError, "sequence item is not marked");
-                self->halt = 1;
-                PyGILState_Release(gs);
-                return;
-            }
+        node = PyObject_CallFunctionObjArgs(self->represent, object, NULL);
+        if (!node) return -1;
+        if (!PyObject_TypeCheck(node, &PySyckNode_Type)) {
+            PyErr_SetString(PyExc_TypeError,
+                    "represent() must return a Node instance");
+            Py_DECREF(node);
+            return -1;
         }
-        syck_emit_end(emitter);
+        if (PyList_Append(self->objects, object) < 0) {
+            Py_DECREF(node);
+            return -1;
+        }
+    }
+
+    symbol = self->symbols_length;
+    if (PySyckEmitter_add_symbol(self, node) < 0) {
+        Py_DECREF(node);
+        return -1;
     }
+    Py_DECREF(node);
+    syck_emitter_mark_node(self->emitter, symbol);
 
-    else if (PyObject_TypeCheck((PyObject *)node, &PySyckMap_Type)) {
+    if (alias && PySyckEmitter_add_mark(self, object, symbol) < 0)
+        return -1;
 
-        syck_emit_map(emitter, tag, ((PySyckMapObject *)node)->style);
-        
-        if (PyList_Check(node->value)) {
-            l = PyList_GET_SIZE(node->value);
-            for (k = 0; k < l; k ++) {
-                pair = PyList_GET_ITEM(node->value, k);
-                if (!PyTuple_Check(pair) || PyTuple_GET_SIZE(pair) != 2) {
-                    PyErr_SetString(PyExc_TypeError,
-                            "value of _syck.Map must be a list of pairs or a dictionary");
-                    self->halt = 1;
-                    PyGILState_Release(gs);
-                    return;
-                }
-                for (j = 0; j < 2; j++) {
-                    item = PyTuple_GET_ITEM(pair, j);
-                    if ((index = PyDict_GetItem(self->nodes, item))) {
-                        syck_emit_item(emitter, PyInt_AS_LONG(index));
-                        if (self->halt) {
-                            PyGILState_Release(gs);
-                            return;
-                        }
-                    }
-                    else {
-                        PyErr_SetString(PyExc_RuntimeError, "mapping item is not marked");
-                        self->halt = 1;
-                        PyGILState_Release(gs);
-                        return;
-                    }
-                }
+    return symbol;
+}
+
+static int
+PySyckEmitter_mark_item(PySyckEmitterObject *self, PyObject *item)
+{
+    long symbol;
+
+    /* 'represent' may change the collection that holds the item. */
+    Py_INCREF(item);
+    symbol = PySyckEmitter_mark_object(self, item);
+    Py_DECREF(item);
+    if (symbol < 0) return -1;
+
+    return PySyckEmitter_add_item(self, symbol);
+}
+
+static int
+PySyckEmitter_mark_dict(PySyckEmitterObject *self, PyObject *dict)
+{
+    Py_ssize_t size = PyDict_Size(dict);
+    Py_ssize_t pos = 0;
+    PyObject *key, *value;
+    int ret;
+
+    while (PyDict_Next(dict, &pos, &key, &value)) {
+        Py_INCREF(value);
+        ret = PySyckEmitter_mark_item(self, key);
+        if (ret == 0)
+            ret = PySyckEmitter_mark_item(self, value);
+        Py_DECREF(value);
+        if (ret < 0) return -1;
+        if (PyDict_Size(dict) != size) {
+            PyErr_SetString(PyExc_RuntimeError,
+                    "dictionary changed size during dumping");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Marks the graph of Nodes, or of Python objects in the native mode. The
+ * children of each collection are stored in 'items', so that the node handler
+ * does not need to look them up. */
+
+static int
+PySyckEmitter_mark(PySyckEmitterObject *self, PyObject *root)
+{
+    PySyckNodeObject *node;
+    PyObject *object, *pair;
+    long current, k;
+    int j;
+
+    self->items_length = 0;
+
+    if (PySyckEmitter_mark_object(self, root) < 0)
+        return -1;
+
+    for (current = 0; current < self->symbols_length; current++) {
+
+        if (PySyckEmitter_set_offset(self, current) < 0)
+            return -1;
+
+        object = self->symbols[current];
+
+        /* Builtin collections are marked only in the native mode. */
+        if (!self->native
+                && !PyObject_TypeCheck(object, &PySyckNode_Type)) {
+            PyErr_SetString(PyExc_TypeError, "Node instance is required");
+            return -1;
+        }
+
+        if (PyList_CheckExact(object)) {
+            for (k = 0; k < PyList_GET_SIZE(object); k++)
+                if (PySyckEmitter_mark_item(self,
+                            PyList_GET_ITEM(object, k)) < 0)
+                    return -1;
+        }
+
+        else if (PyTuple_CheckExact(object)) {
+            for (k = 0; k < PyTuple_GET_SIZE(object); k++)
+                if (PySyckEmitter_mark_item(self,
+                            PyTuple_GET_ITEM(object, k)) < 0)
+                    return -1;
+        }
+
+        else if (PyDict_CheckExact(object)) {
+            if (PySyckEmitter_mark_dict(self, object) < 0)
+                return -1;
+        }
+
+        else if (PyObject_TypeCheck(object, &PySyckSeq_Type)) {
+            node = (PySyckNodeObject *)object;
+            if (!PyList_Check(node->value)) {
+                PyErr_SetString(PyExc_TypeError, "value of _syck.Seq must be a list");
+                return -1;
             }
+            for (k = 0; k < PyList_GET_SIZE(node->value); k++)
+                if (PySyckEmitter_mark_item(self,
+                            PyList_GET_ITEM(node->value, k)) < 0)
+                    return -1;
         }
-        else if (PyDict_Check(node->value)) {
-            dict_pos = 0;
-            while (PyDict_Next(node->value, &dict_pos, &key, &value)) {
-                for (j = 0; j < 2; j++) {
-                    item = j ? value : key;
-                    if ((index = PyDict_GetItem(self->nodes, item))) {
-                        syck_emit_item(emitter, PyInt_AS_LONG(index));
-                        if (self->halt) {
-                            PyGILState_Release(gs);
-                            return;
-                        }
-                    }
-                    else {
-                        PyErr_SetString(PyExc_RuntimeError, "mapping item is not marked");
-                        self->halt = 1;
-                        PyGILState_Release(gs);
-                        return;
+
+        else if (PyObject_TypeCheck(object, &PySyckMap_Type)) {
+            node = (PySyckNodeObject *)object;
+            if (PyList_Check(node->value)) {
+                for (k = 0; k < PyList_GET_SIZE(node->value); k++) {
+                    pair = PyList_GET_ITEM(node->value, k);
+                    if (!PyTuple_Check(pair) || PyTuple_GET_SIZE(pair) != 2) {
+                        PyErr_SetString(PyExc_TypeError,
+                                "value of _syck.Map must be a list of pairs or a dictionary");
+                        return -1;
                     }
+                    Py_INCREF(pair);
+                    for (j = 0; j < 2; j++)
+                        if (PySyckEmitter_mark_item(self,
+                                    PyTuple_GET_ITEM(pair, j)) < 0)
+                            break;
+                    Py_DECREF(pair);
+                    if (j < 2) return -1;
                 }
             }
+            else if (PyDict_Check(node->value)) {
+                if (PySyckEmitter_mark_dict(self, node->value) < 0)
+                    return -1;
+            }
+            else {
+                PyErr_SetString(PyExc_TypeError,
+                        "value of _syck.Map must be a list of pairs or a dictionary");
+                return -1;
+            }
         }
-        else {
-            PyErr_SetString(PyExc_TypeError,
-                    "value of _syck.Map must be a list of pairs or a dictionary");
-            self->halt = 1;
-            PyGILState_Release(gs);
-            return;
-        }
+    }
+
+    return PySyckEmitter_set_offset(self, current);
+}
+
+/* Emits the children of a collection marked by PySyckEmitter_mark(). */
+
+static int
+PySyckEmitter_emit_items(PySyckEmitterObject *self, long symbol)
+{
+    long k;
 
-        syck_emit_end(emitter);
+    for (k = self->offsets[symbol]; k < self->offsets[symbol+1]; k++) {
+        syck_emit_item(self->emitter, self->items[k]);
+        if (self->halt) return -1;
     }
+    syck_emit_end(self->emitter);
+    return 0;
+}
 
-    else if (PyObject_TypeCheck((PyObject *)node, &PySyckScalar_Type)) {
-        if (PyString_AsStringAndSize(node->value, &str, &len) < 0) {
-            self->halt = 1;
-            PyGILState_Release(gs);
-            return;
+/* Emits a symbol. Builtin objects of Emitter.dump_native() are emitted with
+ * the tag and the value that the corresponding Dumper.represent_*() method
+ * would give. */
+
+static int
+PySyckEmitter_emit_symbol(PySyckEmitterObject *self, long symbol)
+{
+    PySyckNodeObject *node;
+    PyObject *object;
+    PyObject *value = NULL;
+    char *tag = NULL;
+    char *str;
+    Py_ssize_t len;
+    char buffer[32];
+    double number;
+
+    if (symbol < 0 || symbol >= self->symbols_length) {
+        PyErr_SetString(PyExc_RuntimeError, "unknown data id");
+        return -1;
+    }
+    object = self->symbols[symbol];
+
+    if (PyObject_TypeCheck(object, &PySyckNode_Type)) {
+        node = (PySyckNodeObject *)object;
+        if (node->tag) {
+            tag = PyString_AsString(node->tag);
+            if (!tag) return -1;
+        }
+        if (PyObject_TypeCheck(object, &PySyckSeq_Type)) {
+            syck_emit_seq(self->emitter, tag,
+                    ((PySyckSeqObject *)node)->style);
+            return PySyckEmitter_emit_items(self, symbol);
+        }
+        if (PyObject_TypeCheck(object, &PySyckMap_Type)) {
+            syck_emit_map(self->emitter, tag,
+                    ((PySyckMapObject *)node)->style);
+            return PySyckEmitter_emit_items(self, symbol);
         }
-        syck_emit_scalar(emitter, tag, ((PySyckScalarObject *)node)->style,
+        if (PyString_AsStringAndSize(node->value, &str, &len) < 0)
+            return -1;
+        syck_emit_scalar(self->emitter, tag,
+                ((PySyckScalarObject *)node)->style,
                 ((PySyckScalarObject *)node)->indent,
                 ((PySyckScalarObject *)node)->width,
                 ((PySyckScalarObject *)node)->chomp, str, len);
+        return 0;
+    }
+
+    if (PyList_CheckExact(object)) {
+        syck_emit_seq(self->emitter, "tag:yaml.org,2002:seq", seq_none);
+        return PySyckEmitter_emit_items(self, symbol);
     }
 
+    if (PyTuple_CheckExact(object)) {
+        syck_emit_seq(self->emitter, "tag:python.yaml.org,2002:tuple",
+                seq_none);
+        return PySyckEmitter_emit_items(self, symbol);
+    }
+
+    if (PyDict_CheckExact(object)) {
+        syck_emit_map(self->emitter, "tag:yaml.org,2002:map", map_none);
+        return PySyckEmitter_emit_items(self, symbol);
+    }
+
+    if (object == Py_None) {
+        tag = "tag:yaml.org,2002:null";
+        str = "~";
+    }
+    else if (PyBool_Check(object)) {
+        tag = "tag:yaml.org,2002:bool";
+        str = (object == Py_True) ? "True" : "False";
+    }
+    else if (PyInt_CheckExact(object)) {
+        tag = "tag:yaml.org,2002:int";
+        PyOS_snprintf(buffer, sizeof(buffer), "%ld", PyInt_AS_LONG(object));
+        str = buffer;
+    }
+    else if (PyFloat_CheckExact(object)) {
+        tag = "tag:yaml.org,2002:float";
+        number = PyFloat_AS_DOUBLE(object);
+        if (number != number)
+            str = ".nan";
+        else if (number == PySyck_InfValue)
+            str = ".inf";
+        else if (number == -PySyck_InfValue)
+            str = "-.inf";
+        else {
+            value = PyObject_Repr(object);
+            if (!value) return -1;
+        }
+    }
+    else if (PyLong_CheckExact(object)) {
+        tag = "tag:python.yaml.org,2002:long";
+        value = PyObject_Repr(object);
+        if (!value) return -1;
+    }
+    else if (PyString_CheckExact(object)) {
+        if (PySyck_is_ascii(PyString_AS_STRING(object),
+                    PyString_GET_SIZE(object)))
+            tag = "tag:yaml.org,2002:str";
+        else
+            tag = "tag:python.yaml.org,2002:str";
+        Py_INCREF(object);
+        value = object;
+    }
+    else if (PyUnicode_CheckExact(object)) {
+        tag = "tag:python.yaml.org,2002:unicode";
+        value = PyUnicode_AsASCIIString(object);
+        if (!value) {
+            if (!PyErr_ExceptionMatches(PyExc_UnicodeEncodeError))
+                return -1;
+            PyErr_Clear();
+            tag = "tag:yaml.org,2002:str";
+            value = PyUnicode_AsUTF8String(object);
+            if (!value) return -1;
+        }
+    }
     else {
         PyErr_SetString(PyExc_TypeError, "Node instance is required");
+        return -1;
+    }
+
+    if (value) {
+        str = PyString_AS_STRING(value);
+        len = PyString_GET_SIZE(value);
+    }
+    else {
+        len = strlen(str);
+    }
+
+    syck_emit_scalar(self->emitter, tag, scalar_none, 0, 0, 0, str, len);
+
+    Py_XDECREF(value);
+    return 0;
+}
+
+static void
+PySyckEmitter_node_handler(SyckEmitter *emitter, st_data_t id)
+{
+    PyGILState_STATE gs;
+
+    PySyckEmitterObject *self = (PySyckEmitterObject *)emitter->bonus;
+
+    if (self->halt) return;
+
+    gs = PyGILState_Ensure();
+
+    if (PySyckEmitter_emit_symbol(self, id) < 0)
         self->halt = 1;
-        PyGILState_Release(gs);
-        return;
-    }   
+
     PyGILState_Release(gs);
 }
 
+/* Writes the buffered output to the output file descriptor. Does not
+ * require the GIL. Returns 0 or errno. */
+
+static int
+PySyckEmitter_write_fd(PySyckEmitterObject *self)
+{
+    char *buf = self->buffer;
+    long length = self->buffer_length;
+    long written;
+
+    self->buffer_length = 0;
+    self->buffer_start = 0;
+
+    while (length > 0) {
+        do {
+            written = write(self->fd, buf, length);
+        } while (written < 0 && errno == EINTR);
+        if (written < 0)
+            return errno;
+        buf += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/* Writes the buffered output to the output stream. Requires the GIL. */
+
+static int
+PySyckEmitter_flush(PySyckEmitterObject *self)
+{
+    PyObject *result;
+    int error;
+
+    if (!self->output || self->in_place || !self->buffer_length)
+        return 0;
+
+    if (self->fd >= 0) {
+        Py_BEGIN_ALLOW_THREADS
+        error = PySyckEmitter_write_fd(self);
+        Py_END_ALLOW_THREADS
+        if (error) {
+            errno = error;
+            PyErr_SetFromErrno(PyExc_IOError);
+            return -1;
+        }
+        return 0;
+    }
+
+    result = PyObject_CallMethod(self->output, "write", "(s#)",
+            self->buffer, (int)self->buffer_length);
+    self->buffer_length = 0;
+    self->buffer_start = 0;
+    if (!result) return -1;
+
+    Py_DECREF(result);
+    return 0;
+}
+
+/* Called with the GIL released; the GIL is taken only when a full block is
+ * written to a Python output stream. A buffer output is written in place. */
+
 static void
 PySyckEmitter_write_handler(SyckEmitter *emitter, char *buf, long len)
 {
     PyGILState_STATE gs;
+    char *buffer;
+    long capacity;
+    int error;
+    void *target;
+    Py_ssize_t length;
 
     PySyckEmitterObject *self = (PySyckEmitterObject *)emitter->bonus;
 
+    if (self->halt) return;
+
+    if (self->target) {
+        if (len > self->target_length-self->position) {
+            gs = PyGILState_Ensure();
+            PyErr_SetString(PyExc_ValueError, "output buffer is full");
+            self->halt = 1;
+            PyGILState_Release(gs);
+            return;
+        }
+        memcpy(self->target+self->position, buf, len);
+        self->position += len;
+        return;
+    }
+
+    if (self->in_place) {
+        /* The buffer is not held; it is looked up and written with the GIL
+         * held, so that it is not resized or closed meanwhile. */
+        gs = PyGILState_Ensure();
+        if (PyObject_AsWriteBuffer(self->output, &target, &length) < 0) {
+            self->halt = 1;
+        }
+        else if (len > length-self->position) {
+            PyErr_SetString(PyExc_ValueError, "output buffer is full");
+            self->halt = 1;
+        }
+        else {
+            memcpy((char *)target+self->position, buf, len);
+            self->position += len;
+        }
+        PyGILState_Release(gs);
+        return;
+    }
+
+    if (self->buffer_length+len > self->buffer_capacity) {
+        capacity = self->buffer_capacity ? self->buffer_capacity
+            : self->bufsize;
+        while (capacity < self->buffer_length+len)
+            capacity *= 2;
+        buffer = realloc(self->buffer, capacity);
+        if (!buffer) {
+            gs = PyGILState_Ensure();
+            PyErr_NoMemory();
+            self->halt = 1;
+            PyGILState_Release(gs);
+            return;
+        }
+        self->buffer = buffer;
+        self->buffer_capacity = capacity;
+    }
+
+    memcpy(self->buffer+self->buffer_length, buf, len);
+    self->buffer_length += len;
+
+    if (!self->output || self->buffer_length < self->bufsize)
+        return;
+
+    if (self->fd >= 0) {
+        if ((error = PySyckEmitter_write_fd(self)) != 0) {
+            gs = PyGILState_Ensure();
+            errno = error;
+            PyErr_SetFromErrno(PyExc_IOError);
+            self->halt = 1;
+            PyGILState_Release(gs);
+        }
+        return;
+    }
+
     gs = PyGILState_Ensure();
-
-    if (!PyObject_CallMethod(self->output, "write", "(s#)", buf, len))
+    if (PySyckEmitter_flush(self) < 0)
         self->halt = 1;
-
     PyGILState_Release(gs);
 }
 
@@ -1765,18 +4745,23 @@ PySyckEmitter_init(PySyckEmitterObject *self, PyObject *args, PyObject *kwds)
     PyObject *style = NULL;
     int best_width = 80;
     int indent = 2;
+    long bufsize = PYSYCK_BUFFER_SIZE;
+    long offset = 0;
 
     char *str;
+    void *buffer;
+    Py_ssize_t length;
 
     static char *kwdlist[] = {"output", "headless", "use_header",
         "use_version", "explicit_typing", "style",
-        "best_width", "indent", NULL};
+        "best_width", "indent", "bufsize", "offset", NULL};
 
     PySyckEmitter_clear(self);
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiiOii", kwdlist,
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiiOiill", kwdlist,
                 &output, &headless, &use_header, &use_version,
-                &explicit_typing, &style, &best_width, &indent))
+                &explicit_typing, &style, &best_width, &indent, &bufsize,
+                &offset))
         return -1;
 
     if (best_width <= 0) {
@@ -1787,6 +4772,10 @@ PySyckEmitter_init(PySyckEmitterObject *self, PyObject *args, PyObject *kwds)
         PyErr_SetString(PyExc_ValueError, "'indent' must be positive");
         return -1;
     }
+    if (bufsize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "'bufsize' must be positive");
+        return -1;
+    }
 
     if (!style || style == Py_None) {
         self->style = scalar_none;
@@ -1822,9 +4811,37 @@ PySyckEmitter_init(PySyckEmitterObject *self, PyObject *args, PyObject *kwds)
     self->explicit_typing = explicit_typing;
     self->best_width = best_width;
     self->indent = indent;
+    self->bufsize = bufsize;
+
+    if (PyInt_CheckExact(output)) {
+        if (PyInt_AS_LONG(output) < 0) {
+            PyErr_SetString(PyExc_ValueError,
+                    "file descriptor must be non-negative");
+            return -1;
+        }
+        self->fd = PyInt_AS_LONG(output);
+    }
+    else if (output != Py_None && !PyString_Check(output)
+            && !PyUnicode_Check(output) && PySyck_CheckWriteBuffer(output)) {
+        /* mmap, array and so on: check that the buffer is writable. */
+        if (PyObject_AsWriteBuffer(output, &buffer, &length) < 0)
+            return -1;
+        if (offset < 0 || offset > length) {
+            PyErr_SetString(PyExc_ValueError, "offset is out of range");
+            return -1;
+        }
+        self->in_place = 1;
+    }
+    if (offset && !self->in_place) {
+        PyErr_SetString(PyExc_ValueError, "offset requires a buffer output");
+        return -1;
+    }
+    self->position = offset;
 
-    Py_INCREF(output);
-    self->output = output;
+    if (output != Py_None) {
+        Py_INCREF(output);
+        self->output = output;
+    }
 
     self->emitting = 0;
     self->halt = 0;
@@ -1832,128 +4849,140 @@ PySyckEmitter_init(PySyckEmitterObject *self, PyObject *args, PyObject *kwds)
     return 0;
 }
 
+static void
+PySyckEmitter_release_target(PySyckEmitterObject *self)
+{
+    if (!self->target) return;
+
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    PyBuffer_Release(&self->view);
+#endif
+    self->target = NULL;
+    self->target_length = 0;
+}
+
+/* Prepares the Syck emitter for a document. The emitter is created once and
+ * kept between documents; only its anchor tables are reset. */
+
+static void
+PySyckEmitter_start(PySyckEmitterObject *self)
+{
+    if (self->emitter) {
+        syck_emitter_st_free(self->emitter);
+    }
+    else {
+        self->emitter = syck_new_emitter();
+        self->emitter->bonus = self;
+        self->emitter->use_header = self->use_header;
+        self->emitter->use_version = self->use_version;
+        self->emitter->explicit_typing = self->explicit_typing;
+        self->emitter->style = self->style;
+        self->emitter->best_width = self->best_width;
+        self->emitter->indent = self->indent;
+
+        syck_emitter_handler(self->emitter, PySyckEmitter_node_handler);
+        syck_output_handler(self->emitter, PySyckEmitter_write_handler);
+    }
+
+    /* Syck clears the flag after each document. */
+    self->emitter->headless = self->headless;
+}
+
+/* Holds the buffer output for a document, so that it is written without the
+ * GIL. Buffers that cannot be held are written by the write handler with the
+ * GIL held. */
+
 static int
-PySyckEmitter_mark(PySyckEmitterObject *self, PyObject *root_node)
+PySyckEmitter_hold_target(PySyckEmitterObject *self)
 {
-    int current, last;
-    int j, k, l;
-    PySyckNodeObject *node;
-    PyObject *item, *key, *value, *pair;
-    PyObject *index;
-    int dict_pos;
+    void *buffer;
+    Py_ssize_t length;
+
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    if (PyObject_CheckBuffer(self->output)) {
+        if (PyObject_GetBuffer(self->output, &self->view, PyBUF_WRITABLE) < 0)
+            return -1;
+        self->target = self->view.buf;
+        self->target_length = self->view.len;
+        if (self->position > self->target_length) {
+            PyErr_SetString(PyExc_ValueError, "output buffer is full");
+            PySyckEmitter_release_target(self);
+            return -1;
+        }
+        return 0;
+    }
+#endif
 
-    last = 0;
-    syck_emitter_mark_node(self->emitter, last);
-    if (PyList_Append(self->symbols, root_node) < 0)
+    if (PyObject_AsWriteBuffer(self->output, &buffer, &length) < 0)
         return -1;
-    index = PyInt_FromLong(last);
-    if (!index) return -1;
-    if (PyDict_SetItem(self->nodes, root_node, index) < 0) {
-        Py_DECREF(index);
+    if (self->position > length) {
+        PyErr_SetString(PyExc_ValueError, "output buffer is full");
         return -1;
     }
-    Py_DECREF(index);
+    return 0;
+}
 
-    for (current = 0; current < PyList_GET_SIZE(self->symbols); current++) {
+/* Marks and emits a document: a Node tree, or a Python object in the
+ * native mode. The output is left in the buffer. */
 
-        node = (PySyckNodeObject *)PyList_GET_ITEM(self->symbols, current);
+static int
+PySyckEmitter_emit_document(PySyckEmitterObject *self, PyObject *node)
+{
+    long position = self->position;
 
-        if (PyObject_TypeCheck((PyObject *)node, &PySyckSeq_Type)) {
-            if (!PyList_Check(node->value)) {
-                PyErr_SetString(PyExc_TypeError, "value of _syck.Seq must be a list");
-                return -1;
-            }
-            l = PyList_GET_SIZE(node->value);
-            for (k = 0; k < l; k ++) {
-                item = PyList_GET_ITEM(node->value, k);
-                if ((index = PyDict_GetItem(self->nodes, item))) {
-                    syck_emitter_mark_node(self->emitter, PyInt_AS_LONG(index));
-                }
-                else {
-                    syck_emitter_mark_node(self->emitter, ++last);
-                    if (PyList_Append(self->symbols, item) < 0)
-                        return -1;
-                    index = PyInt_FromLong(last);
-                    if (!index) return -1;
-                    if (PyDict_SetItem(self->nodes, item, index) < 0) {
-                        Py_DECREF(index);
-                        return -1;
-                    }
-                    Py_DECREF(index);
-                }
-            }
-        }
+    self->buffer_start = self->buffer_length;
+    PySyckEmitter_start(self);
 
-        else if (PyObject_TypeCheck((PyObject *)node, &PySyckMap_Type)) {
-            
-            if (PyList_Check(node->value)) {
-                l = PyList_GET_SIZE(node->value);
-                for (k = 0; k < l; k ++) {
-                    pair = PyList_GET_ITEM(node->value, k);
-                    if (!PyTuple_Check(pair) || PyTuple_GET_SIZE(pair) != 2) {
-                        PyErr_SetString(PyExc_TypeError,
-                                "value of _syck.Map must be a list of pairs or a dictionary");
-                        return -1;
-                    }
-                    for (j = 0; j < 2; j++) {
-                        item = PyTuple_GET_ITEM(pair, j);
-                        if ((index = PyDict_GetItem(self->nodes, item))) {
-                            syck_emitter_mark_node(self->emitter, PyInt_AS_LONG(index));
-                        }
-                        else {
-                            syck_emitter_mark_node(self->emitter, ++last);
-                            if (PyList_Append(self->symbols, item) < 0)
-                                return -1;
-                            index = PyInt_FromLong(last);
-                            if (!index) return -1;
-                            if (PyDict_SetItem(self->nodes, item, index) < 0) {
-                                Py_DECREF(index);
-                                return -1;
-                            }
-                            Py_DECREF(index);
-                        }
-                    }
-                }
-                
-            }
-            else if (PyDict_Check(node->value)) {
-                dict_pos = 0;
-                while (PyDict_Next(node->value, &dict_pos, &key, &value)) {
-                    for (j = 0; j < 2; j++) {
-                        item = j ? value : key;
-                        if ((index = PyDict_GetItem(self->nodes, item))) {
-                            syck_emitter_mark_node(self->emitter, PyInt_AS_LONG(index));
-                        }
-                        else {
-                            syck_emitter_mark_node(self->emitter, ++last);
-                            if (PyList_Append(self->symbols, item) < 0)
-                                return -1;
-                            index = PyInt_FromLong(last);
-                            if (!index) return -1;
-                            if (PyDict_SetItem(self->nodes, item, index) < 0) {
-                                Py_DECREF(index);
-                                return -1;
-                            }
-                            Py_DECREF(index);
-                        }
-                    }
-                }
-            }
-            else {
-                PyErr_SetString(PyExc_TypeError,
-                        "value of _syck.Map must be a list of pairs or a dictionary");
-                return -1;
-            }
-        }
+    /* The buffer output is held after marking, which may call Python. */
+    if (PySyckEmitter_mark(self, node) < 0
+            || (self->in_place && PySyckEmitter_hold_target(self) < 0)) {
+        self->halt = 1;
+    }
+    else {
+        Py_BEGIN_ALLOW_THREADS
+        syck_emit(self->emitter, 0);
+        syck_emitter_flush(self->emitter, 0);
+        Py_END_ALLOW_THREADS
+    }
 
-        else if (!PyObject_TypeCheck((PyObject *)node, &PySyckScalar_Type)) {
-            PyErr_SetString(PyExc_TypeError, "Node instance is required");
-            return -1;
-        }   
+    PySyckEmitter_clear_symbols(self);
+    PySyckEmitter_release_target(self);
+
+    if (self->halt) {
+        /* The position does not move past a document that failed, and its
+         * output that is not written yet is dropped. */
+        self->position = position;
+        self->buffer_length = self->buffer_start;
+        /* The Syck emitter may be left in the middle of the document. */
+        syck_free_emitter(self->emitter);
+        self->emitter = NULL;
+        return -1;
     }
+
     return 0;
 }
 
+static PyObject *
+PySyckEmitter_run(PySyckEmitterObject *self, PyObject *node)
+{
+    int ret;
+
+    self->emitting = 1;
+
+    ret = PySyckEmitter_emit_document(self, node);
+    if (!ret && PySyckEmitter_flush(self) < 0) {
+        self->halt = 1;
+        ret = -1;
+    }
+
+    self->emitting = 0;
+
+    if (ret < 0) return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
 static PyObject *
 PySyckEmitter_emit(PySyckEmitterObject *self, PyObject *args)
 {
@@ -1972,73 +5001,172 @@ PySyckEmitter_emit(PySyckEmitterObject *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "O", &node))
         return NULL;
 
-    self->emitting = 1;
+    return PySyckEmitter_run(self, node);
+}
+
+PyDoc_STRVAR(PySyckEmitter_emit_doc,
+    "emit(root_node) -> None\n\n"
+    "Emits the Node tree to the output.\n");
 
+static PyObject *
+PySyckEmitter_emit_many(PySyckEmitterObject *self, PyObject *args)
+{
+    PyObject *nodes, *iterator, *node;
+    PyObject *type, *value, *traceback;
+    int ret = 0;
 
-    self->symbols = PyList_New(0);
-    if (!self->symbols) {
+    if (self->emitting) {
+        PyErr_SetString(PyExc_RuntimeError, "do not call Emitter.emit_many while it is already emitting");
         return NULL;
     }
-    self->nodes = PyDict_New();
-    if (!self->nodes) {
-        Py_DECREF(self->symbols);
-        self->symbols = NULL;
+
+    if (self->halt) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    if (!PyArg_ParseTuple(args, "O", &nodes))
         return NULL;
+
+    iterator = PyObject_GetIter(nodes);
+    if (!iterator) return NULL;
+
+    self->emitting = 1;
+
+    while ((node = PyIter_Next(iterator))) {
+        ret = PySyckEmitter_emit_document(self, node);
+        Py_DECREF(node);
+        if (ret < 0) break;
     }
+    Py_DECREF(iterator);
 
-    self->emitter = syck_new_emitter();
-    self->emitter->bonus = self;
-    self->emitter->headless = self->headless;
-    self->emitter->use_header = self->use_header;
-    self->emitter->use_version = self->use_version;
-    self->emitter->explicit_typing = self->explicit_typing;
-    self->emitter->style = self->style;
-    self->emitter->best_width = self->best_width;
-    self->emitter->indent = self->indent;
-
-    syck_emitter_handler(self->emitter, PySyckEmitter_node_handler);
-    syck_output_handler(self->emitter, PySyckEmitter_write_handler);
-
-    if (PySyckEmitter_mark(self, node) < 0) {
-        Py_DECREF(self->symbols);
-        self->symbols = NULL;
-        Py_DECREF(self->nodes);
-        self->nodes = NULL;
-        self->emitting = 0;
+    /* If the iterator or a document fails, the documents emitted before are
+     * written and the exception is raised. */
+    if (ret < 0 || PyErr_Occurred()) {
+        PyErr_Fetch(&type, &value, &traceback);
+        if (PySyckEmitter_flush(self) < 0) {
+            self->halt = 1;
+            PyErr_Clear();
+        }
+        PyErr_Restore(type, value, traceback);
+        ret = -1;
+    }
+    if (!ret && PySyckEmitter_flush(self) < 0) {
         self->halt = 1;
-        syck_free_emitter(self->emitter);
-        self->emitter = NULL;
+        ret = -1;
+    }
+
+    self->emitting = 0;
+
+    if (ret < 0) return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+PyDoc_STRVAR(PySyckEmitter_emit_many_doc,
+    "emit_many(root_nodes) -> None\n\n"
+    "Emits each Node tree of the iterable as a document. The output is\n"
+    "written in blocks of 'bufsize' bytes across the documents.\n");
+
+static PyObject *
+PySyckEmitter_dump_native(PySyckEmitterObject *self, PyObject *args,
+        PyObject *kwds)
+{
+    PyObject *object;
+    PyObject *types = NULL;
+    PyObject *result;
+    long mask;
+
+    static char *kwdlist[] = {"object", "types", NULL};
+
+    if (self->emitting) {
+        PyErr_SetString(PyExc_RuntimeError,
+                "do not call Emitter.dump_native while it is already emitting");
         return NULL;
     }
 
-    Py_BEGIN_ALLOW_THREADS
-    syck_emit(self->emitter, 0);
-    syck_emitter_flush(self->emitter, 0);
-    Py_END_ALLOW_THREADS
+    if (self->halt) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
 
-    syck_free_emitter(self->emitter);
-    self->emitter = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwdlist,
+                &object, &types))
+        return NULL;
 
-    self->emitting = 0;
+    mask = PySyck_dump_types_mask(types);
+    if (mask < 0) return NULL;
 
-    Py_DECREF(self->symbols);
-    self->symbols = NULL;
-    Py_DECREF(self->nodes);
-    self->nodes = NULL;
+    self->represent = PyObject_GetAttrString((PyObject *)self, "represent");
+    if (!self->represent) {
+        if (!PyErr_ExceptionMatches(PyExc_AttributeError))
+            return NULL;
+        PyErr_Clear();
+    }
 
-    if (self->halt) return NULL;
+    self->objects = PyList_New(0);
+    if (!self->objects) {
+        Py_XDECREF(self->represent);
+        self->represent = NULL;
+        return NULL;
+    }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    self->native = 1;
+    self->native_types = mask;
+
+    result = PySyckEmitter_run(self, object);
+
+    self->native = 0;
+    Py_XDECREF(self->represent);
+    self->represent = NULL;
+    Py_DECREF(self->objects);
+    self->objects = NULL;
+
+    return result;
 }
 
-PyDoc_STRVAR(PySyckEmitter_emit_doc,
-    "emit(root_node) -> None\n\n"
-    "Emits the Node tree to the output.\n");
+PyDoc_STRVAR(PySyckEmitter_dump_native_doc,
+    "dump_native(object, types=None) -> None\n\n"
+    "Emits a Python object to the output without building a Node tree.\n"
+    "Objects of the builtin types listed in 'types' (all of them if None:\n"
+    "'NoneType', 'bool', 'int', 'long', 'float', 'str', 'unicode', 'list',\n"
+    "'tuple' and 'dict') are emitted in C like Dumper represents them.\n"
+    "Other objects are passed to the method 'represent', which must return\n"
+    "a Node; the children of the Node are dumped in turn.\n");
+
+static PyObject *
+PySyckEmitter_getvalue(PySyckEmitterObject *self)
+{
+    /* The buffer is reallocated without the GIL while a document is
+     * emitted. */
+    if (self->emitting) {
+        PyErr_SetString(PyExc_RuntimeError, "do not call Emitter.getvalue while it is emitting");
+        return NULL;
+    }
+
+    if (self->output) {
+        PyErr_SetString(PyExc_ValueError,
+                "the output is written to the output stream");
+        return NULL;
+    }
+
+    return PyString_FromStringAndSize(self->buffer, self->buffer_length);
+}
+
+PyDoc_STRVAR(PySyckEmitter_getvalue_doc,
+    "getvalue() -> a string\n\n"
+    "Returns the YAML stream produced so far if the output is None.\n");
 
 static PyMethodDef PySyckEmitter_methods[] = {
     {"emit",  (PyCFunction)PySyckEmitter_emit,
         METH_VARARGS, PySyckEmitter_emit_doc},
+    {"emit_many",  (PyCFunction)PySyckEmitter_emit_many,
+        METH_VARARGS, PySyckEmitter_emit_many_doc},
+    {"dump_native",  (PyCFunction)PySyckEmitter_dump_native,
+        METH_VARARGS|METH_KEYWORDS, PySyckEmitter_dump_native_doc},
+    {"getvalue",  (PyCFunction)PySyckEmitter_getvalue,
+        METH_NOARGS, PySyckEmitter_getvalue_doc},
     {NULL}  /* Sentinel */
 };
 
@@ -2088,7 +5216,211 @@ static PyTypeObject PySyckEmitter_Type = {
  * The module _syck.
  ****************************************************************************/
 
+/* Checks if the line starts with the document marker '---' or '...'. */
+
+static int
+PySyck_is_marker(const char *line, Py_ssize_t length, char ch)
+{
+    if (length < 3 || line[0] != ch || line[1] != ch || line[2] != ch)
+        return 0;
+    return length == 3 || line[3] == ' ' || line[3] == '\t'
+        || line[3] == '\r' || line[3] == '\n';
+}
+
+/* Checks if the line is empty or contains only a comment. */
+
+static int
+PySyck_is_blank(const char *line, Py_ssize_t length)
+{
+    Py_ssize_t k;
+
+    for (k = 0; k < length; k++) {
+        if (line[k] == '#' || line[k] == '\n')
+            return 1;
+        if (line[k] != ' ' && line[k] != '\t' && line[k] != '\r')
+            return 0;
+    }
+    return 1;
+}
+
+static int
+PySyck_add_offset(Py_ssize_t **offsets, Py_ssize_t *count,
+        Py_ssize_t *capacity, Py_ssize_t offset)
+{
+    Py_ssize_t *grown;
+
+    if (*count == *capacity) {
+        *capacity = *capacity ? 2*(*capacity) : 64;
+        grown = realloc(*offsets, (*capacity)*sizeof(Py_ssize_t));
+        if (!grown) return -1;
+        *offsets = grown;
+    }
+    (*offsets)[(*count)++] = offset;
+    return 0;
+}
+
+/* Finds the offsets of the documents; called without the global lock.
+ * Returns the number of offsets or -1 if the memory is exhausted. */
+
+static Py_ssize_t
+PySyck_scan(const char *buffer, Py_ssize_t length, Py_ssize_t **offsets)
+{
+    Py_ssize_t count = 0;
+    Py_ssize_t capacity = 0;
+    Py_ssize_t start = 0;       /* the start of the current document */
+    Py_ssize_t directives = -1; /* the start of trailing directive lines */
+    Py_ssize_t position = 0;
+    Py_ssize_t next;
+    int started = 0;
+    const char *line;
+    const char *end;
+
+    *offsets = NULL;
+
+    while (position < length) {
+        line = buffer+position;
+        end = memchr(line, '\n', length-position);
+        next = end ? end-buffer+1 : length;
+
+        if (PySyck_is_marker(line, next-position, '-')) {
+            if (started) {
+                if (PySyck_add_offset(offsets, &count, &capacity, start) < 0)
+                    goto error;
+                start = directives >= 0 ? directives : position;
+            }
+            started = 1;
+            directives = -1;
+        }
+        else if (PySyck_is_marker(line, next-position, '.')) {
+            if (started
+                    && PySyck_add_offset(offsets, &count, &capacity, start) < 0)
+                goto error;
+            start = next;
+            started = 0;
+            directives = -1;
+        }
+        else if (*line == '%') {
+            if (directives < 0)
+                directives = position;
+        }
+        else {
+            directives = -1;
+            if (!PySyck_is_blank(line, next-position))
+                started = 1;
+        }
+
+        position = next;
+    }
+
+    if (started && PySyck_add_offset(offsets, &count, &capacity, start) < 0)
+        goto error;
+
+    return count;
+
+error:
+    free(*offsets);
+    *offsets = NULL;
+    return -1;
+}
+
+static PyObject *
+PySyck_scan_documents(PyObject *self, PyObject *args)
+{
+    PyObject *source;
+    PyObject *result;
+    PyObject *offset;
+    const void *buffer;
+    Py_ssize_t length;
+    Py_ssize_t *offsets;
+    Py_ssize_t count;
+    Py_ssize_t k;
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    Py_buffer view;
+#endif
+
+    if (!PyArg_ParseTuple(args, "O", &source))
+        return NULL;
+
+    if (PyUnicode_Check(source)) {
+        PyErr_SetString(PyExc_TypeError, "source must be a string or a buffer");
+        return NULL;
+    }
+
+    /* The GIL is released only while the memory cannot be resized or freed:
+     * for a string or a held Py_buffer view. */
+#ifdef PYSYCK_HAVE_BUFFER_VIEW
+    if (PyObject_CheckBuffer(source)) {
+        if (PyObject_GetBuffer(source, &view, PyBUF_SIMPLE) < 0)
+            return NULL;
+        Py_BEGIN_ALLOW_THREADS
+        count = PySyck_scan(view.buf, view.len, &offsets);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&view);
+    }
+    else
+#endif
+    if (PyString_Check(source)) {
+        buffer = PyString_AS_STRING(source);
+        length = PyString_GET_SIZE(source);
+        Py_BEGIN_ALLOW_THREADS
+        count = PySyck_scan(buffer, length, &offsets);
+        Py_END_ALLOW_THREADS
+    }
+    else {
+        if (PyObject_AsReadBuffer(source, &buffer, &length) < 0)
+            return NULL;
+        count = PySyck_scan(buffer, length, &offsets);
+    }
+
+    if (count < 0)
+        return PyErr_NoMemory();
+
+    result = PyList_New(count);
+    if (!result) goto exit;
+
+    for (k = 0; k < count; k++) {
+        offset = PyInt_FromLong(offsets[k]);
+        if (!offset) {
+            Py_DECREF(result);
+            result = NULL;
+            goto exit;
+        }
+        PyList_SET_ITEM(result, k, offset);
+    }
+
+exit:
+    free(offsets);
+    return result;
+}
+
+PyDoc_STRVAR(PySyck_scan_documents_doc,
+    "scan_documents(source) -> a list of offsets\n\n"
+    "Scans a string or a buffer for document boundaries, i.e. '---' and\n"
+    "'...' lines, and returns the offsets where documents start. Directive\n"
+    "lines go with the following document. A Parser started at an offset\n"
+    "parses the documents from there.\n");
+
+static PyObject *
+PySyck_decode(PyObject *self, PyObject *args)
+{
+    PyObject *value;
+
+    if (!PyArg_ParseTuple(args, "S", &value))
+        return NULL;
+
+    return PySyck_decode_str(value);
+}
+
+PyDoc_STRVAR(PySyck_decode_doc,
+    "decode_str(value) -> a string or a unicode object\n\n"
+    "Returns 'value' itself if it is ASCII, and decodes it from UTF-8\n"
+    "otherwise. Raises UnicodeDecodeError if it is not valid UTF-8.\n");
+
 static PyMethodDef PySyck_methods[] = {
+    {"scan_documents", (PyCFunction)PySyck_scan_documents,
+        METH_VARARGS, PySyck_scan_documents_doc},
+    {"decode_str", (PyCFunction)PySyck_decode,
+        METH_VARARGS, PySyck_decode_doc},
     {NULL}  /* Sentinel */
 };
 
@@ -2140,6 +5472,16 @@ init_syck(void)
 
     PyEval_InitThreads();   /* Fix segfault for Python 2.3 */
 
+    PySyck_InfValue = Py_HUGE_VAL;
+    PySyck_NaNValue = PySyck_InfValue/PySyck_InfValue;
+
+#ifdef PYSYCK_HAVE_DATETIME
+    /* Without the datetime module, timestamps are left to the Loader. */
+    PyDateTime_IMPORT;
+    if (!PyDateTimeAPI)
+        PyErr_Clear();
+#endif
+
     if (PyType_Ready(&PySyckNode_Type) < 0)
         return;
     if (PyType_Ready(&PySyckScalar_Type) < 0)
@@ -5,11 +5,6 @@ Do not use it directly, use the module 'syck' instead.
 
 import _syck
 
-try:
-    import cStringIO as StringIO
-except ImportError:
-    import StringIO
-
 import copy_reg
 
 __all__ = ['GenericDumper', 'Dumper',
@@ -74,6 +69,52 @@ class Dumper(GenericDumper):
     neginf_value = repr(-INF)
     nan_value = repr(INF/INF)
 
+    native_types = ['NoneType', 'bool', 'int', 'long', 'float',
+            'str', 'unicode', 'list', 'tuple', 'dict']
+
+    def dump(self, object):
+        """
+        Dumps the given Python object as a YAML document.
+
+        Objects of the builtin types are emitted in C unless the
+        corresponding representers are redefined in a subclass.
+        """
+        types = self.find_native_types()
+        if types is None:
+            return super(Dumper, self).dump(object)
+        self.dump_native(object, types)
+
+    def find_native_types(self):
+        """
+        Returns the list of builtin types that 'dump_native()' may emit
+        without calling the Python representers, or None if the Python
+        representers must be used for all objects.
+
+        The result is cached in the class.
+        """
+        cls = self.__class__
+        if '_native_types' not in cls.__dict__:
+            cls._native_types = cls._get_native_types()
+        return cls._native_types
+
+    def _get_native_types(cls):
+        for name in ['emit', 'represent', 'find_representer', '_convert',
+                'allow_aliases']:
+            if getattr(cls, name) != getattr(Dumper, name):
+                return None
+        types = []
+        for name in cls.native_types:
+            method = 'represent_'+name
+            if getattr(cls, method, None) != getattr(Dumper, method, None):
+                continue
+            if name == 'float' and (cls.inf_value != Dumper.inf_value
+                    or cls.neginf_value != Dumper.neginf_value
+                    or cls.nan_value != Dumper.nan_value):
+                continue
+            types.append(name)
+        return types
+    _get_native_types = classmethod(_get_native_types)
+
     def find_representer(self, object):
         """
         For the given object, find a method that can represent it as a 'Node'
@@ -263,13 +304,10 @@ def emit(node, output=None, Dumper=Dumper, **parameters):
 
     If output is None, returns the produced YAML document.
     """
-    if output is None:
-        dumper = Dumper(StringIO.StringIO(), **parameters)
-    else:
-        dumper = Dumper(output, **parameters)
+    dumper = Dumper(output, **parameters)
     dumper.emit(node)
     if output is None:
-        return dumper.output.getvalue()
+        return dumper.getvalue()
 
 def dump(object, output=None, Dumper=Dumper, **parameters):
     """
@@ -277,13 +315,10 @@ def dump(object, output=None, Dumper=Dumper, **parameters):
 
     If output is None, returns the produced YAML document.
     """
-    if output is None:
-        dumper = Dumper(StringIO.StringIO(), **parameters)
-    else:
-        dumper = Dumper(output, **parameters)
+    dumper = Dumper(output, **parameters)
     dumper.dump(object)
     if output is None:
-        return dumper.output.getvalue()
+        return dumper.getvalue()
 
 def emit_documents(nodes, output=None, Dumper=Dumper, **parameters):
     """
@@ -291,14 +326,14 @@ def emit_documents(nodes, output=None, Dumper=Dumper, **parameters):
     
     If output is None, returns the produced YAML document.
     """
-    if output is None:
-        dumper = Dumper(StringIO.StringIO(), **parameters)
+    dumper = Dumper(output, **parameters)
+    if Dumper.emit == _syck.Emitter.emit:
+        dumper.emit_many(nodes)
     else:
-        dumper = Dumper(output, **parameters)
-    for node in nodes:
-        dumper.emit(node)
+        for node in nodes:
+            dumper.emit(node)
     if output is None:
-        return dumper.output.getvalue()
+        return dumper.getvalue()
 
 def dump_documents(objects, output=None, Dumper=Dumper, **parameters):
     """
@@ -306,13 +341,10 @@ def dump_documents(objects, output=None, Dumper=Dumper, **parameters):
     
     If output is None, returns the produced YAML document.
     """
-    if output is None:
-        dumper = Dumper(StringIO.StringIO(), **parameters)
-    else:
-        dumper = Dumper(output, **parameters)
+    dumper = Dumper(output, **parameters)
     for object in objects:
         dumper.dump(object)
     if output is None:
-        return dumper.output.getvalue()
+        return dumper.getvalue()
 
 
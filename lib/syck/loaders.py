@@ -25,20 +25,55 @@ except:
 
 import _syck
 
-import sys, re, warnings
+import sys, os, re, warnings
+
+try:
+    import cStringIO as StringIO
+except ImportError:
+    import StringIO
+
+try:
+    import mmap
+except ImportError:
+    mmap = None
+
+try:
+    import threading
+except ImportError:
+    threading = None
 
 __all__ = ['GenericLoader', 'Loader',
     'parse', 'load', 'parse_documents', 'load_documents',
+    'parse_file', 'load_file', 'load_items', 'iterparse',
+    'load_documents_parallel', 'FeedParser', 'FeedLoader', 'DocumentIndex',
     'NotUnicodeInputWarning']
 
 class NotUnicodeInputWarning(UserWarning):
     pass
 
+def _map_file(path):
+    # Maps the file into memory, so that the parser reads it in place.
+    stream = open(path, 'rb')
+    try:
+        if mmap is not None:
+            stream.seek(0, 2)
+            if stream.tell():
+                return mmap.mmap(stream.fileno(), 0, access=mmap.ACCESS_READ)
+            return ''
+        return stream.read()
+    finally:
+        stream.close()
+
 class GenericLoader(_syck.Parser):
     """
     GenericLoader constructs primitive Python objects from YAML documents.
     """
 
+    def from_path(cls, path, **parameters):
+        """Creates a loader that parses the memory-mapped file 'path'."""
+        return cls(_map_file(path), **parameters)
+    from_path = classmethod(from_path)
+
     def load(self):
         """
         Loads a YAML document from the source and return a native Python
@@ -60,26 +95,22 @@ class GenericLoader(_syck.Parser):
             for item_node in node.value:
                 value.append(self._convert(item_node, node_to_object))
         elif node.kind == 'map':
-            value = {}
+            # Convert every pair once; if a key is unhashable or repeated,
+            # the converted pairs are used as a list.
+            pairs = []
             for key_node in node.value:
-                key_object = self._convert(key_node, node_to_object)
-                value_object = self._convert(node.value[key_node],
-                        node_to_object)
+                pairs.append((self._convert(key_node, node_to_object),
+                        self._convert(node.value[key_node], node_to_object)))
+            value = {}
+            for key_object, value_object in pairs:
                 try:
                     if key_object in value:
-                        value = None
+                        value = pairs
                         break
                     value[key_object] = value_object
                 except TypeError:
-                    value = None
+                    value = pairs
                     break
-            if value is None:
-                value = []
-                for key_node in node.value:
-                    key_object = self._convert(key_node, node_to_object)
-                    value_object = self._convert(node.value[key_node],
-                            node_to_object)
-                    value.append((key_object, value_object))
         node.value = value
         object = self.construct(node)
         node_to_object[node] = object
@@ -129,6 +160,75 @@ class Loader(GenericLoader):
     class python_class:
         pass
 
+    native_types = ['null', 'bool_yes', 'bool_no', 'str',
+            'int', 'int_hex', 'int_oct', 'int_base60',
+            'float', 'float_fix', 'float_exp', 'float_base60',
+            'float_inf', 'float_neginf', 'float_nan',
+            'timestamp', 'timestamp_ymd', 'timestamp_iso8601',
+            'timestamp_spaced', 'seq', 'map']
+
+    def load(self):
+        """
+        Loads a YAML document from the source and return a native Python
+        object. On EOF, returns None and set the eof attribute on.
+
+        Nodes of the core YAML types are constructed in C unless the
+        corresponding constructors are redefined in a subclass or in the
+        instance.
+        """
+        types = self.find_native_types()
+        if types is None:
+            return super(Loader, self).load()
+        return self.load_native(types)
+
+    def find_native_types(self):
+        """
+        Returns the list of core types that 'load_native()' may construct
+        without calling the Python constructors, or None if the Python
+        constructors must be used for all nodes.
+
+        The result for the class is cached in the class. Constructors and
+        other attributes redefined in the instance are checked on every call.
+        """
+        cls = self.__class__
+        if '_native_types' not in cls.__dict__:
+            cls._native_types = cls._get_native_types()
+        types = cls._native_types
+        if types is not None and self.__dict__:
+            types = self._filter_native_types(types, self.__dict__.has_key)
+        return types
+
+    def _get_native_types(cls):
+        def is_redefined(name):
+            value = getattr(cls, name, None)
+            default = getattr(Loader, name, None)
+            return value is not default and value != default
+        return cls._filter_native_types(cls.native_types, is_redefined)
+    _get_native_types = classmethod(_get_native_types)
+
+    def _filter_native_types(types, is_redefined):
+        # Drops the types whose construction depends on a redefined attribute.
+        for name in ['construct', 'find_constructor', '_convert']:
+            if is_redefined(name):
+                return None
+        result = []
+        for name in types:
+            if is_redefined('construct_'+name):
+                continue
+            if name in ['float_inf', 'float_neginf', 'float_nan'] \
+                    and (is_redefined('inf_value')
+                        or is_redefined('nan_value')):
+                continue
+            if name in ['int_base60', 'float_base60'] \
+                    and is_redefined('construct_numeric_base60'):
+                continue
+            if name.startswith('timestamp') \
+                    and is_redefined('timestamp_expr'):
+                continue
+            result.append(name)
+        return result
+    _filter_native_types = staticmethod(_filter_native_types)
+
     def find_constructor(self, node):
         """
         Returns the contructor for generating a Python object for the given
@@ -144,10 +244,32 @@ class Loader(GenericLoader):
         tag:domain.tld,2002:type        construct_domain_tld_2002_type
 
         See the method code for more details.
+
+        The constructor names of the class methods are cached in the class
+        by tag, so constructors should not be added to the class after
+        loading. If the instance defines constructors, the cache is not used.
         """
+        cls = self.__class__
+        for name in self.__dict__:
+            if name.startswith('construct_'):
+                method = self._find_constructor_name(node.tag, self)
+                break
+        else:
+            if '_constructors' not in cls.__dict__:
+                cls._constructors = {}
+            try:
+                method = cls._constructors[node.tag]
+            except KeyError:
+                method = cls._constructors[node.tag] = \
+                        self._find_constructor_name(node.tag, cls)
+        if method is not None:
+            return getattr(self, method)
+
+    def _find_constructor_name(self, tag, owner):
+        # Returns the name of the constructor of 'owner' for the tag.
         parts = []
-        if node.tag:
-            parts = node.tag.split(':')
+        if tag:
+            parts = tag.split(':')
         if parts:
             if parts[0] == 'tag':
                 parts.pop(0)
@@ -161,8 +283,8 @@ class Loader(GenericLoader):
         parts = [part.translate(self.non_ascii) for part in parts]
         while parts:
             method = 'construct_'+'_'.join(parts)
-            if hasattr(self, method):
-                return getattr(self, method)
+            if hasattr(owner, method):
+                return method
             parts.pop()
 
     def construct(self, node):
@@ -186,14 +308,10 @@ class Loader(GenericLoader):
 
     def construct_str(self, node):
         try:
-            value = unicode(node.value, 'utf-8')
+            return _syck.decode_str(node.value)
         except UnicodeDecodeError:
             warnings.warn("scalar value is not utf-8", NotUnicodeInputWarning)
             return node.value
-        try:
-            return value.encode('ascii')
-        except UnicodeEncodeError:
-            return value
 
     def construct_numeric_base60(self, num_type, node):
         digits = [num_type(part) for part in node.value.split(':')]
@@ -405,6 +523,16 @@ def load(source, Loader=Loader, **parameters):
     loader = Loader(source, **parameters)
     return loader.load()
 
+def parse_file(path, Loader=Loader, **parameters):
+    """Parses the file 'path' and returns the root 'Node'."""
+    loader = Loader.from_path(path, **parameters)
+    return loader.parse()
+
+def load_file(path, Loader=Loader, **parameters):
+    """Parses the file 'path' and returns the root object."""
+    loader = Loader.from_path(path, **parameters)
+    return loader.load()
+
 def parse_documents(source, Loader=Loader, **parameters):
     """Iterates over 'source' and yields the root 'Node' for each document."""
     loader = Loader(source, **parameters)
@@ -423,3 +551,481 @@ def load_documents(source, Loader=Loader, **parameters):
             break
         yield object
 
+# A node may carry an anchor or be an alias only where a node starts: at the
+# beginning of a line or a sequence entry, after a mapping indicator or inside
+# a flow collection, optionally after a tag.
+_item_node_start = r'(?:^[ \t]*(?:[-?][ \t]+)*|:[ \t]+|[\[{,][ \t]*)' \
+        r'(?:![^\s,\[\]{}]*[ \t]+)?'
+_item_anchor_re = re.compile(_item_node_start+r'&([^\s,\[\]{}]+)', re.M)
+_item_alias_re = re.compile(_item_node_start+r'\*([^\s,\[\]{}]+)', re.M)
+_item_key_re = re.compile(r':(?:[ \t]|$)')
+_item_merge_re = re.compile(r'<<[ \t]*:(?:[ \t]|$)', re.M)
+
+def _is_entry(line, kind):
+    # Checks if the line starts a new entry of the root collection.
+    if line[:1] in ' \t\r\n#':
+        return False
+    if line[:3] in ['---', '...'] and line[3:4] in ['', ' ', '\t', '\r', '\n']:
+        return False
+    dash = line[:1] == '-' and line[1:2] in ['', ' ', '\t', '\r', '\n']
+    if kind == 'seq':
+        return dash
+    return not dash and not (line[:1] == ':'
+            and line[1:2] in ['', ' ', '\t', '\r', '\n'])
+
+def _as_seq_entry(text):
+    # Turns an entry of the root mapping into an entry of a root sequence.
+    lines = text.splitlines(True)
+    return ''.join(['- '+lines[0]]+['  '+line for line in lines[1:]])
+
+def _whole_items(object, count=0, keys=()):
+    # Yields the items of a fully loaded document, skipping the first 'count'
+    # items of a sequence and the 'keys' of a mapping.
+    if isinstance(object, list):
+        for item in object[count:]:
+            yield item
+    elif isinstance(object, dict):
+        for item in object.items():
+            if item[0] not in keys:
+                yield item
+    elif object is not None and not count and not keys:
+        yield object
+
+def load_items(source, Loader=Loader, **parameters):
+    """
+    Iterates over the first document of 'source' and yields the items of
+    the root sequence, or the (key, value) pairs of the root mapping, as
+    soon as each of them is parsed.
+
+    The root collection must be in the block style. Its entries are split
+    at the lines that start them and parsed one by one, so the document is
+    never built as a whole. An entry that refers to an anchor of a previous
+    entry is parsed together with it and the entries it depends on in turn,
+    and gets an equal copy of the anchored object. Other documents, and
+    documents whose entries turn out not to parse separately, are loaded
+    in full.
+    """
+    if isinstance(source, str) or not hasattr(source, 'read'):
+        source = StringIO.StringIO(source)
+    elif not hasattr(source, 'readline'):
+        source = StringIO.StringIO(source.read())
+    # The consumed text is kept only if the document cannot be reread.
+    try:
+        start = source.tell()
+    except (AttributeError, IOError):
+        start = None
+    document = []
+    kind = None
+    while True:
+        line = source.readline()
+        if not line:
+            break
+        document.append(line)
+        stripped = line.strip()
+        if not stripped or stripped.startswith('#') or line.startswith('%'):
+            continue
+        if stripped == '---':
+            continue
+        if _is_entry(line, 'seq'):
+            kind = 'seq'
+        elif line[:1] not in '[{!&*|>?' and not line.startswith('---') \
+                and _item_key_re.search(line.rstrip()) \
+                and _is_entry(line, 'map'):
+            kind = 'map'
+        break
+    if kind is None:
+        object = load(''.join(document)+source.read(), Loader, **parameters)
+        for item in _whole_items(object):
+            yield item
+        return
+    line = document.pop()
+    anchored = []   # the anchored entries: (text, dependencies)
+    anchors = {}    # anchor -> the index of the entry in 'anchored'
+    count = 0       # the number of yielded sequence items
+    keys = {}       # the yielded mapping keys
+    end = ''
+    while line:
+        lines = [line]
+        while True:
+            line = source.readline()
+            if not line or line[:3] in ['---', '...'] \
+                    and line[3:4] in ['', ' ', '\t', '\r', '\n']:
+                end = line
+                line = None
+                break
+            if _is_entry(line, kind):
+                break
+            lines.append(line)
+        text = ''.join(lines)
+        dependencies = {}
+        for name in _item_alias_re.findall(text):
+            if name in anchors:
+                index = anchors[name]
+                dependencies[index] = None
+                for index in anchored[index][1]:
+                    dependencies[index] = None
+        dependencies = dependencies.keys()
+        dependencies.sort()
+        texts = [anchored[index][0] for index in dependencies]+[text]
+        items = None
+        try:
+            if kind == 'seq':
+                object = load(''.join(texts), Loader, **parameters)
+                if isinstance(object, list) and object:
+                    items = object[-1:]
+            elif _item_merge_re.match(text):
+                # A merge key may be overridden later in the document.
+                pass
+            elif not dependencies:
+                object = load(text, Loader, **parameters)
+                if isinstance(object, dict):
+                    items = object.items()
+            else:
+                # The entries are parsed as items of a sequence, so that a
+                # key of a dependency does not hide the key of the entry.
+                object = load(''.join(map(_as_seq_entry, texts)),
+                        Loader, **parameters)
+                if isinstance(object, list) and object \
+                        and isinstance(object[-1], dict):
+                    items = object[-1].items()
+        except (_syck.error, ValueError):
+            pass
+        if items is None:
+            # The entry does not parse on its own, e.g. the root collection
+            # is not in the block style after all, or a flow collection or
+            # a quoted scalar continues at the first column.
+            if start is not None:
+                source.seek(start)
+                text = source.read()
+            else:
+                text = ''.join(document)+text+(line or end)+source.read()
+            object = load(text, Loader, **parameters)
+            for item in _whole_items(object, count, keys):
+                yield item
+            return
+        if start is None:
+            document.append(text)
+        names = _item_anchor_re.findall(text)
+        if names:
+            for name in names:
+                anchors[name] = len(anchored)
+            anchored.append((text, dependencies))
+        for item in items:
+            if kind == 'seq':
+                count += 1
+            else:
+                keys[item[0]] = None
+            yield item
+
+def iterparse(source, Loader=Loader, **parameters):
+    """
+    Iterates over 'source' and yields parsing events:
+        ('start_document',), ('end_document',),
+        ('scalar', tag, anchor, value), ('alias', anchor),
+        ('start_seq', tag, anchor), ('end_seq',),
+        ('start_map', tag, anchor), ('end_map',).
+    Syck reports the nodes of a document bottom-up, so each document is
+    held in memory as a whole before its first event is generated; the
+    nodes are released as their events are yielded. Only
+    'Parser.parse_events()' processes nodes without storing them.
+    """
+    loader = Loader(source, **parameters)
+    while True:
+        nodes = {}
+        def callback(kind, id, tag, anchor, value):
+            nodes[id] = (kind, tag, anchor, value)
+        root = loader.parse_events(callback)
+        if loader.eof:
+            break
+        yield ('start_document',)
+        seen = {}
+        stack = [root]
+        while stack:
+            id = stack.pop()
+            if isinstance(id, tuple):
+                yield id
+                continue
+            if id in seen:
+                yield ('alias', seen[id])
+                continue
+            kind, tag, anchor, value = nodes.pop(id)
+            if anchor is not None:
+                seen[id] = anchor
+            if kind == 'scalar':
+                yield ('scalar', tag, anchor, value)
+            elif kind == 'seq':
+                yield ('start_seq', tag, anchor)
+                stack.append(('end_seq',))
+                children = list(value)
+                children.reverse()
+                stack.extend(children)
+            else:
+                yield ('start_map', tag, anchor)
+                stack.append(('end_map',))
+                children = []
+                for key, item in value:
+                    children.append(key)
+                    children.append(item)
+                children.reverse()
+                stack.extend(children)
+        yield ('end_document',)
+
+class FeedParser:
+    """
+    FeedParser is a push parser. Feed it with chunks of a YAML stream as
+    they arrive; 'feed()' returns the root 'Node' of every document that
+    is complete so far, and never waits for more data.
+
+    Syck cannot suspend in the middle of a document, so the input is split
+    at document boundaries ('---' and '...' lines) and each complete
+    document is parsed at once. A document is complete when the next one
+    starts; the last document is returned by 'close()'.
+    """
+
+    marker_re = re.compile(r'^(---|\.\.\.)(?=[ \t\r\n]|\Z)', re.M)
+    content_re = re.compile(r'^(?:[ \t]*[^\s#%]|[ \t]+%)', re.M)
+
+    def __init__(self, Loader=Loader, **parameters):
+        self.Loader = Loader
+        self.parameters = parameters
+        self.chunks = []        # complete lines of the current document
+        self.tail = []          # the pieces of the last incomplete line
+        self.started = False    # whether the current document has content
+
+    def feed(self, data):
+        """Adds 'data' to the stream and returns the complete documents."""
+        return self._convert(self._split(data))
+
+    def close(self):
+        """Finishes the stream and returns the remaining documents."""
+        return self._convert([self._finish()])
+
+    def _split(self, data):
+        # Returns the sources of the documents finished by 'data'. Only the
+        # lines completed by 'data' are scanned, so that feeding a document
+        # in small chunks takes linear time.
+        end = data.rfind('\n')+1
+        if not end:
+            if data:
+                self.tail.append(data)
+            return []
+        self.tail.append(data[:end])
+        text = ''.join(self.tail)
+        self.tail = []
+        if end < len(data):
+            self.tail.append(data[end:])
+        sources = []
+        start = 0
+        for match in self.marker_re.finditer(text):
+            self._append(text[start:match.start()])
+            start = match.start()
+            if match.group(1) == '---':
+                if self.started:
+                    source = ''.join(self.chunks)
+                    # Trailing directives belong to the next document.
+                    directives = self._directives(source)
+                    sources.append(source[:directives])
+                    self.chunks = [source[directives:]]
+                self.started = True
+            else:
+                start = text.find('\n', start)+1
+                self.chunks.append(text[match.start():start])
+                sources.append(''.join(self.chunks))
+                self.chunks = []
+                self.started = False
+        self._append(text[start:])
+        return sources
+
+    def _append(self, text):
+        # Appends complete lines to the current document.
+        if text:
+            self.chunks.append(text)
+            if not self.started and self.content_re.search(text):
+                self.started = True
+
+    def _directives(self, source):
+        # Returns the start of the directive lines that end 'source'.
+        end = len(source)
+        while end:
+            start = source.rfind('\n', 0, end-1)+1
+            if source[start:start+1] != '%':
+                break
+            end = start
+        return end
+
+    def _finish(self):
+        # Returns the source of the last document.
+        self.chunks.extend(self.tail)
+        source = ''.join(self.chunks)
+        self.chunks = []
+        self.tail = []
+        self.started = False
+        return source
+
+    def _convert(self, sources):
+        documents = []
+        for source in sources:
+            documents.extend(parse_documents(source, self.Loader,
+                **self.parameters))
+        return documents
+
+class FeedLoader(FeedParser):
+    """
+    FeedLoader is a push loader. It is similar to FeedParser, but returns
+    native Python objects.
+    """
+
+    def _convert(self, sources):
+        documents = []
+        for source in sources:
+            documents.extend(load_documents(source, self.Loader,
+                **self.parameters))
+        return documents
+
+class _Batch:
+    # A run of documents loaded by a worker thread.
+
+    def __init__(self, source, Loader, parameters):
+        self.source = source
+        self.Loader = Loader
+        self.parameters = parameters
+        self.documents = None
+        self.error = None
+        self.thread = threading.Thread(target=self.run)
+        self.thread.setDaemon(True)
+        self.thread.start()
+
+    def run(self):
+        try:
+            self.documents = list(load_documents(self.source, self.Loader,
+                **self.parameters))
+        except:
+            self.error = sys.exc_info()
+        self.source = None
+
+    def join(self):
+        self.thread.join()
+        if self.error:
+            error = self.error
+            self.error = None
+            raise error[0], error[1], error[2]
+        return self.documents
+
+_directive_re = re.compile(r'^%', re.M)
+
+def load_documents_parallel(source, Loader=Loader, workers=4,
+        batch_size=65536, **parameters):
+    """
+    Iterates over 'source' and yields the root object for each document,
+    like 'load_documents()', but parses documents in 'workers' threads.
+
+    The stream is split at document boundaries into batches of about
+    'batch_size' bytes. Each batch is parsed by a deferred loader, which
+    releases the global lock while Syck parses a document; the Python
+    objects are still built one thread at a time. Documents are yielded
+    in stream order. Streams with directives are loaded sequentially.
+    """
+    if not isinstance(source, str) and hasattr(source, 'read'):
+        source = source.read()
+    if threading is None or workers < 2 or not isinstance(source, str) \
+            or _directive_re.search(source):
+        for document in load_documents(source, Loader, **parameters):
+            yield document
+        return
+    parameters = parameters.copy()
+    parameters.setdefault('deferred', True)
+    # The documents are found in C; a batch is a slice of the source.
+    offsets = _syck.scan_documents(source)+[len(source)]
+    pending = []
+    start = offsets[0]
+    for end in offsets[1:]:
+        if end-start < batch_size and end < len(source):
+            continue
+        pending.append(_Batch(source[start:end], Loader, parameters))
+        start = end
+        if len(pending) >= workers:
+            for document in pending.pop(0).join():
+                yield document
+    while pending:
+        for document in pending.pop(0).join():
+            yield document
+
+class DocumentIndex:
+    """
+    DocumentIndex gives random access to the documents of a stream.
+
+    The offsets of the documents are found by 'scan_documents()' from the
+    module '_syck', which looks for '---' and '...' lines in C. The source
+    must be a string or a buffer; 'from_path()' maps a file and keeps its
+    index in a file next to it, so the stream is scanned only once.
+    """
+
+    header = 'pysyck-index 1'
+
+    def __init__(self, source, offsets=None):
+        if offsets is None:
+            offsets = _syck.scan_documents(source)
+        self.source = source
+        self.offsets = offsets
+
+    def from_path(cls, path, index_path=None):
+        """
+        Maps the file 'path' and reads its index from 'index_path' (by
+        default, 'path' with the suffix '.idx'). If the index is missing or
+        out of date, scans the file and saves the index.
+        """
+        if index_path is None:
+            index_path = path+'.idx'
+        source = _map_file(path)
+        stamp = cls._stamp(path)
+        offsets = None
+        try:
+            stream = open(index_path, 'rb')
+        except IOError:
+            pass
+        else:
+            try:
+                lines = stream.read().split('\n')
+            finally:
+                stream.close()
+            if lines[0] == '%s %s' % (cls.header, stamp):
+                offsets = [int(line) for line in lines[1:] if line]
+        index = cls(source, offsets)
+        if offsets is None:
+            try:
+                index.save(index_path, stamp)
+            except (IOError, OSError):
+                pass
+        return index
+    from_path = classmethod(from_path)
+
+    def _stamp(cls, path):
+        # The size and the modification time identify the file version. The
+        # time is kept with the precision of the file system, so that a
+        # change within the same second is detected.
+        info = os.stat(path)
+        return '%d %r' % (info.st_size, float(info.st_mtime))
+    _stamp = classmethod(_stamp)
+
+    def save(self, index_path, stamp=''):
+        """Writes the offsets to the file 'index_path'."""
+        stream = open(index_path, 'wb')
+        try:
+            stream.write('%s %s\n' % (self.header, stamp))
+            for offset in self.offsets:
+                stream.write('%d\n' % offset)
+        finally:
+            stream.close()
+
+    def __len__(self):
+        return len(self.offsets)
+
+    def parse(self, number, Loader=Loader, **parameters):
+        """Parses the document 'number' and returns its root 'Node'."""
+        loader = Loader(self.source, offset=self.offsets[number], **parameters)
+        return loader.parse()
+
+    def load(self, number, Loader=Loader, **parameters):
+        """Parses the document 'number' and returns the root object."""
+        loader = Loader(self.source, offset=self.offsets[number], **parameters)
+        return loader.load()
@@ -170,4 +170,44 @@ class TestCollectionTypes(unittest.TestCase):
             self.assertEqual(type(a), type(b))
             self.assertEqual(a, b)
 
+NATIVE = [
+    None, True, False, 0, -4567, 12345678901234567890, 123.4e-5, INF, -INF,
+    'foo', 'foo, bar, baz', '\xe2\x98\xba', '\xff\xfe', u'foo', u'\u263a',
+    [], (), {}, ['foo', ('bar', 1)], {'foo': {'bar': [1, 2.0]}},
+    datetime.datetime(2001, 12, 15, 2, 59, 43, 100000), Set(range(3)),
+]
+NATIVE.append(NATIVE[-4])
+
+class PythonDumper(syck.Dumper):
+
+    def represent(self, object):
+        return super(PythonDumper, self).represent(object)
+
+class TestNativeDumper(unittest.TestCase):
+
+    def testNativeTypes(self):
+        self.assertEqual(PythonDumper(None).find_native_types(), None)
+        self.assertEqual(syck.Dumper(None).find_native_types(),
+                syck.Dumper.native_types)
+
+    def testNativeDumper(self):
+        document = syck.load(syck.dump(NATIVE))
+        self.assertEqual(document,
+                syck.load(syck.dump(NATIVE, Dumper=PythonDumper)))
+        for a, b in zip(document, NATIVE):
+            self.assertEqual(type(a), type(b))
+        self.assert_(document[-1] is document[-5])
 
+    def testNativeOddAliases(self):
+        document = syck.parse(syck.dump(ODD_ALIASES))
+        for group in document.value:
+            for item in group.value[1:]:
+                self.assert_(item is not group.value[0])
+
+    def testDumpNative(self):
+        output = StringIO.StringIO()
+        emitter = syck.Emitter(output)
+        emitter.dump_native({'foo': ['bar', 1]})
+        self.assertEqual(syck.load(output.getvalue()), {'foo': ['bar', 1]})
+        emitter = syck.Emitter(StringIO.StringIO())
+        self.assertRaises(TypeError, lambda: emitter.dump_native(Set()))
@@ -3,7 +3,7 @@ import unittest
 
 import _syck
 
-import StringIO, gc
+import StringIO, gc, os, array
 
 EXAMPLE = _syck.Seq([
         _syck.Scalar('Mark McGwire'),
@@ -151,9 +151,10 @@ class TestAttributes(unittest.TestCase):
         self.assertEqual(emitter.style, None)
         self.assertEqual(emitter.best_width, 80)
         self.assertEqual(emitter.indent, 2)
+        self.assertEqual(emitter.bufsize, 65536)
         emitter = _syck.Emitter(output, headless=True, use_header=True,
                 use_version=True, explicit_typing=True, style='fold',
-                best_width=100, indent=4)
+                best_width=100, indent=4, bufsize=1024)
         self.assertEqual(emitter.headless, True)
         self.assertEqual(emitter.use_header, True)
         self.assertEqual(emitter.use_version, True)
@@ -161,6 +162,7 @@ class TestAttributes(unittest.TestCase):
         self.assertEqual(emitter.style, 'fold')
         self.assertEqual(emitter.best_width, 100)
         self.assertEqual(emitter.indent, 4)
+        self.assertEqual(emitter.bufsize, 1024)
 
     def testInvalidTypesAndValues(self):
         self.assertRaises(TypeError, lambda: _syck.Emitter(None, headless='on'))
@@ -174,6 +176,8 @@ class TestAttributes(unittest.TestCase):
         self.assertRaises(TypeError, lambda: _syck.Emitter(None, indent='2'))
         self.assertRaises(ValueError, lambda: _syck.Emitter(None, indent=0))
         self.assertRaises(ValueError, lambda: _syck.Emitter(None, indent=-2))
+        self.assertRaises(TypeError, lambda: _syck.Emitter(None, bufsize='1024'))
+        self.assertRaises(ValueError, lambda: _syck.Emitter(None, bufsize=0))
 
     def testHeadless(self):
         emitter = _syck.Emitter(StringIO.StringIO(), headless=False)
@@ -230,6 +234,46 @@ class TestExample(unittest.TestCase):
         parser.parse()
         self.assert_(parser.eof)
 
+    def testEmitMany(self):
+        output = StringIO.StringIO()
+        emitter = _syck.Emitter(output)
+        emitter.emit(ALIASES)
+        emitter.emit(EXAMPLE)
+        emitter.emit(ALIASES)
+        value = output.getvalue()
+        emitter = _syck.Emitter(None)
+        emitter.emit_many(iter([ALIASES, EXAMPLE, ALIASES]))
+        self.assertEqual(emitter.getvalue(), value)
+        parser = _syck.Parser(emitter.getvalue())
+        node = parser.parse()
+        self.assert_(node.value[0] is node.value[1])
+        self.assertEqual(strip(EXAMPLE), strip(parser.parse()))
+        node = parser.parse()
+        self.assert_(node.value[0] is node.value[1])
+        emitter.emit_many([])
+        self.assertEqual(emitter.getvalue(), value)
+
+    def testEmitManyErrors(self):
+        emitter = _syck.Emitter(StringIO.StringIO())
+        self.assertRaises(TypeError, lambda: emitter.emit_many(None))
+        def nodes():
+            yield EXAMPLE
+            emitter.emit(EXAMPLE)
+        self.assertRaises(RuntimeError, lambda: emitter.emit_many(nodes()))
+        value = _syck.Emitter(StringIO.StringIO())
+        value.emit(EXAMPLE)
+        self.assertEqual(emitter.output.getvalue(), value.output.getvalue())
+        emitter.emit(EXAMPLE)
+        value = _syck.Emitter(StringIO.StringIO())
+        value.emit_many([EXAMPLE, EXAMPLE])
+        self.assertEqual(emitter.output.getvalue(), value.output.getvalue())
+        emitter = _syck.Emitter(StringIO.StringIO())
+        self.assertRaises(TypeError,
+                lambda: emitter.emit_many([EXAMPLE, INVALID_ROOT]))
+        value = _syck.Emitter(StringIO.StringIO())
+        value.emit(EXAMPLE)
+        self.assertEqual(emitter.output.getvalue(), value.output.getvalue())
+
 class TestAliases(unittest.TestCase):
 
     def testAliases(self):
@@ -239,6 +283,20 @@ class TestAliases(unittest.TestCase):
         node = parser.parse()
         self.assert_(node.value[0] is node.value[1])
 
+    def testManyAliases(self):
+        scalars = [_syck.Scalar(str(k)) for k in range(200)]
+        document = _syck.Seq(scalars+scalars)
+        emitter = _syck.Emitter(StringIO.StringIO())
+        emitter.emit(document)
+        emitter.emit(document)
+        parser = _syck.Parser(emitter.output.getvalue())
+        for k in range(2):
+            node = parser.parse()
+            self.assertEqual(len(node.value), 400)
+            for index in range(200):
+                self.assertEqual(node.value[index].value, str(index))
+                self.assert_(node.value[index] is node.value[index+200])
+
 class TestTags(unittest.TestCase):
 
     def testTags(self):
@@ -273,9 +331,81 @@ class TestInvalidNodes(unittest.TestCase):
 class TestOutput(unittest.TestCase):
 
     def testBadOutput(self):
-        emitter = _syck.Emitter(None)
+        emitter = _syck.Emitter(object())
         self.assertRaises(AttributeError, lambda: emitter.emit(EXAMPLE))
 
+    def testNoOutput(self):
+        emitter = _syck.Emitter(None)
+        self.assertEqual(emitter.output, None)
+        self.assertEqual(emitter.getvalue(), '')
+        emitter.emit(EXAMPLE)
+        emitter.emit(EXAMPLE)
+        output = StringIO.StringIO()
+        _syck.Emitter(output).emit(EXAMPLE)
+        self.assertEqual(emitter.getvalue(), output.getvalue()*2)
+        self.assertRaises(ValueError, lambda: _syck.Emitter(output).getvalue())
+
+    def testGetValueWhileEmitting(self):
+        class Emitter(_syck.Emitter):
+            def represent(self, object):
+                self.getvalue()
+        emitter = Emitter(None)
+        self.assertRaises(RuntimeError,
+                lambda: emitter.dump_native([Exception()]))
+
+    def testFileDescriptor(self):
+        output = os.tmpfile()
+        emitter = _syck.Emitter(output.fileno(), bufsize=16)
+        self.assertEqual(emitter.output, output.fileno())
+        emitter.emit(EXAMPLE)
+        emitter.emit(EXAMPLE)
+        value = _syck.Emitter(None)
+        value.emit(EXAMPLE)
+        value.emit(EXAMPLE)
+        output.seek(0)
+        self.assertEqual(output.read(), value.getvalue())
+        self.assertRaises(ValueError, lambda: _syck.Emitter(-1))
+
+    def testBuffer(self):
+        value = _syck.Emitter(None)
+        value.emit(EXAMPLE)
+        value = value.getvalue()
+        output = array.array('c', '.'*(len(value)*2+10))
+        emitter = _syck.Emitter(output, offset=10)
+        self.assertEqual(emitter.position, 10)
+        emitter.emit(EXAMPLE)
+        self.assertEqual(emitter.position, len(value)+10)
+        emitter.emit(EXAMPLE)
+        self.assertEqual(emitter.position, len(value)*2+10)
+        self.assertEqual(output.tostring(), '.'*10+value*2)
+        self.assertRaises(ValueError, lambda: emitter.getvalue())
+
+    def testBufferOverflow(self):
+        output = array.array('c', '.'*10)
+        emitter = _syck.Emitter(output)
+        self.assertRaises(ValueError, lambda: emitter.emit(EXAMPLE))
+        self.assertEqual(emitter.position, 0)
+        self.assertRaises(ValueError, lambda: _syck.Emitter(output, offset=11))
+        self.assertRaises(ValueError,
+                lambda: _syck.Emitter(StringIO.StringIO(), offset=1))
+
+    def testBlocks(self):
+        class Stream:
+            def __init__(self):
+                self.blocks = []
+            def write(self, data):
+                self.blocks.append(data)
+        document = _syck.Seq([_syck.Scalar('x'*100)]*100)
+        output = Stream()
+        _syck.Emitter(output).emit(document)
+        self.assertEqual(len(output.blocks), 1)
+        value = output.blocks[0]
+        output = Stream()
+        _syck.Emitter(output, bufsize=1024).emit(document)
+        self.assertEqual(''.join(output.blocks), value)
+        for block in output.blocks[:-1]:
+            self.assert_(len(block) >= 1024)
+
     def testDouble(self):
         class Stream:
             def __init__(self):
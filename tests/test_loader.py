@@ -2,7 +2,7 @@
 import unittest
 import syck
 import test_parser
-import os
+import os, tempfile
 
 try:
     import datetime
@@ -200,6 +200,26 @@ class TestValuesAndSources(test_parser.TestValuesAndSources):
         self.assertEqual(syck.load(tempfile), structure)
         tempfile.seek(0)
 
+    def _testBufferValues(self, (source, structure)):
+        self.assertEqualStructure(syck.parse(buffer(source)), structure)
+        self.assertEqual(syck.load(buffer(source)), structure)
+
+    def testPathValues(self):
+        for source, structure in [test_parser.COMPARE1,
+                test_parser.COMPARE2, test_parser.COMPARE3, ('', None)]:
+            path = tempfile.mktemp()
+            stream = open(path, 'wb')
+            stream.write(source)
+            stream.close()
+            try:
+                if structure is not None:
+                    self.assertEqualStructure(syck.parse_file(path), structure)
+                self.assertEqual(syck.load_file(path), structure)
+                loader = syck.Loader.from_path(path)
+                self.assertEqual(loader.load(), structure)
+            finally:
+                os.remove(path)
+
 class TestImplicitScalars(unittest.TestCase):
 
 
@@ -284,6 +304,194 @@ class TestAliasesParsingAndLoading(unittest.TestCase):
         document = syck.load(ALIASES)
         self.assert_(document['foo'] is document['bar'])
 
+class TestIterparse(unittest.TestCase):
+
+    def testEvents(self):
+        events = list(syck.iterparse(test_parser.ALIASES))
+        self.assertEqual([event[0] for event in events], ['start_document',
+            'start_seq', 'scalar', 'alias', 'end_seq', 'end_document'])
+        self.assertEqual(events[2][2:], ('alias', 'foo'))
+        self.assertEqual(events[3], ('alias', 'alias'))
+
+    def testDocuments(self):
+        events = list(syck.iterparse(test_parser.DOCUMENTS3))
+        self.assertEqual(events.count(('start_document',)), 3)
+        self.assertEqual(events.count(('end_document',)), 3)
+
+ITEMS = """
+# Records
+---
+- name: foo
+  value: &value [1, 2]
+- name: bar
+  value: *value
+- - baz
+  - 3
+"""
+
+class TestSelect(unittest.TestCase):
+
+    def testSelect(self):
+        self.assertEqual(syck.load(test_parser.SELECT,
+                select='services.*.endpoints'), {'services': {
+                    'web': {'endpoints': ['/', '/login']},
+                    'db': {'endpoints': ['/sql']}}})
+        self.assertEqual(syck.load(test_parser.SELECT, Loader=PythonLoader,
+                select='version'), {'version': 2})
+
+class TestLoadItems(unittest.TestCase):
+
+    def testSequence(self):
+        items = syck.load_items(ITEMS)
+        self.assertEqual(items.next(), {'name': 'foo', 'value': [1, 2]})
+        self.assertEqual(list(items), [{'name': 'bar', 'value': [1, 2]},
+            ['baz', 3]])
+
+    def testMapping(self):
+        items = list(syck.load_items("foo: 1\nbar:\n- 2\n- 3\n...\nbaz: 4\n"))
+        self.assertEqual(items, [('foo', 1), ('bar', [2, 3])])
+
+    def testFile(self):
+        stream = os.tmpfile()
+        stream.write(ITEMS)
+        stream.seek(0)
+        self.assertEqual(list(syck.load_items(stream)), syck.load(ITEMS))
+
+    def testFlow(self):
+        self.assertEqual(list(syck.load_items("[foo, bar]")), ['foo', 'bar'])
+        self.assertEqual(list(syck.load_items("{foo: bar}")), [('foo', 'bar')])
+
+    def testScalar(self):
+        for source in ["12:30:00\n", "http://example.com\n", "foo\n"]:
+            self.assertEqual(list(syck.load_items(source)), [syck.load(source)])
+
+    def testTransitiveAliases(self):
+        self.assertEqual(list(syck.load_items(
+            "- &a [1]\n- &b {x: *a}\n- *b\n")),
+            [[1], {'x': [1]}, {'x': [1]}])
+        self.assertEqual(list(syck.load_items(
+            "a: &a [1]\nb: &b {x: *a}\nc: *b\n")),
+            [('a', [1]), ('b', {'x': [1]}), ('c', {'x': [1]})])
+
+    def testIndicatorsInScalars(self):
+        self.assertEqual(list(syck.load_items("- &a R&D\n- a*b\n- *a\n")),
+                ['R&D', 'a*b', 'R&D'])
+        self.assertEqual(list(syck.load_items("a: R&D\nb: a*b\n")),
+                [('a', 'R&D'), ('b', 'a*b')])
+
+    def testMisplitEntries(self):
+        for source in ["a: [1,\n2]\nb: 3\n", "a: 'x\ny'\nb: 3\n"]:
+            items = list(syck.load_items(source))
+            items.sort()
+            expected = syck.load(source).items()
+            expected.sort()
+            self.assertEqual(items, expected)
+
+    def testMergeKey(self):
+        source = "base: &base {x: 1, y: 2}\n<<: *base\ny: 3\n"
+        items = list(syck.load_items(source))
+        items.sort()
+        self.assertEqual(items, [('base', {'x': 1, 'y': 2}), ('x', 1),
+            ('y', 3)])
+
+    def testRepeatedKey(self):
+        self.assertEqual(list(syck.load_items("foo: &a 1\nfoo: *a\n")),
+                [('foo', 1), ('foo', 1)])
+
+class TestParallelDocuments(unittest.TestCase):
+
+    def testParallel(self):
+        source = test_parser.DOCUMENTS3*10
+        expected = list(syck.load_documents(source))
+        for batch_size in [1, 100, 65536]:
+            documents = list(syck.load_documents_parallel(source,
+                batch_size=batch_size))
+            self.assertEqual(documents, expected)
+
+    def testFallback(self):
+        source = "%YAML:1.0\n--- foo\n--- bar\n"
+        self.assertEqual(list(syck.load_documents_parallel(source)),
+                list(syck.load_documents(source)))
+
+    def testError(self):
+        documents = syck.load_documents_parallel("--- foo\n--- [bar\n",
+                batch_size=1)
+        self.assertRaises(syck.error, lambda: list(documents))
+
+class TestDocumentIndex(unittest.TestCase):
+
+    def testIndex(self):
+        documents = list(syck.load_documents(test_parser.DOCUMENTS3))
+        index = syck.DocumentIndex(test_parser.DOCUMENTS3)
+        self.assertEqual(len(index), 3)
+        for k in [2, 0, 1]:
+            self.assertEqual(index.load(k), documents[k])
+
+    def testPath(self):
+        documents = list(syck.load_documents(test_parser.DOCUMENTS3))
+        path = tempfile.mktemp()
+        stream = open(path, 'wb')
+        stream.write(test_parser.DOCUMENTS3)
+        stream.close()
+        try:
+            index = syck.DocumentIndex.from_path(path)
+            self.assertEqual(index.load(2), documents[2])
+            self.assert_(os.path.exists(path+'.idx'))
+            index = syck.DocumentIndex.from_path(path)
+            self.assertEqual(index.offsets,
+                    syck.scan_documents(test_parser.DOCUMENTS3))
+            self.assertEqual(index.load(1), documents[1])
+        finally:
+            del index
+            os.remove(path)
+            if os.path.exists(path+'.idx'):
+                os.remove(path+'.idx')
+
+    def testStaleIndex(self):
+        path = tempfile.mktemp()
+        try:
+            for source, mtime in [('--- a\n--- b\n--- c\n', 1000.25),
+                    ('--- abcd\n--- efgh\n', 1000.75)]:
+                stream = open(path, 'wb')
+                stream.write(source)
+                stream.close()
+                os.utime(path, (mtime, mtime))
+                index = syck.DocumentIndex.from_path(path)
+                self.assertEqual(index.offsets, syck.scan_documents(source))
+                del index
+        finally:
+            os.remove(path)
+            if os.path.exists(path+'.idx'):
+                os.remove(path+'.idx')
+
+class TestFeedLoader(unittest.TestCase):
+
+    def testChunks(self):
+        expected = list(syck.load_documents(test_parser.DOCUMENTS3))
+        for size in [1, 7, 1000]:
+            loader = syck.FeedLoader()
+            documents = []
+            source = test_parser.DOCUMENTS3
+            for k in range(0, len(source), size):
+                documents.extend(loader.feed(source[k:k+size]))
+            self.assertEqual(len(documents), 2)
+            documents.extend(loader.close())
+            self.assertEqual(documents, expected)
+
+    def testDocumentEnd(self):
+        loader = syck.FeedLoader()
+        self.assertEqual(loader.feed('--- foo\n'), [])
+        self.assertEqual(loader.feed('...\n--- [bar'), ['foo'])
+        self.assertEqual(loader.feed(']\n'), [])
+        self.assertEqual(loader.close(), [['bar']])
+
+    def testNodes(self):
+        parser = syck.FeedParser()
+        self.assertEqual(parser.feed('- foo\n'), [])
+        nodes = parser.feed('---\n')
+        self.assertEqual(len(nodes), 1)
+        self.assertEqual(nodes[0].kind, 'seq')
+
 class TestMutableKey(unittest.TestCase):
 
     def testMutableKey(self):
@@ -302,3 +510,122 @@ class TestMutableKey(unittest.TestCase):
         self.assertEqual(len(document[1]), 2)
         self.assertEqual(document[0][0], document[1][0])
 
+    def testConvertedOnce(self):
+        for source in [MUTABLE_KEY, DUPLICATE_KEY]:
+            loader = CountingLoader(source)
+            document = loader.load()
+            self.assertEqual(type(document), list)
+            calls = loader.calls
+            self.assertEqual(len(calls), len(dict.fromkeys(calls)))
+
+class CountingLoader(syck.Loader):
+
+    def __init__(self, *args, **kwds):
+        super(CountingLoader, self).__init__(*args, **kwds)
+        self.calls = []
+
+    def _convert(self, node, node_to_object):
+        self.calls.append(id(node))
+        return super(CountingLoader, self)._convert(node, node_to_object)
+
+NATIVE = """
+- ~
+- [yes, no, on, off]
+- [685230, 0x0A74AE, 02472256, 12345678901234567890]
+- [685230.15, 6.8523015e+5, .inf, -.inf]
+- [a string, "a unicode string: \xe2\x98\xba"]
+- &anchor { foo: bar, 1: 2 }
+- *anchor
+- 2002-12-14
+- [1:30, 190:20:30, 0x10, 017, 9223372036854775808, 1:30.5]
+- [2001-12-14t21:59:43-05:00, 2001-12-14 21:59:43 +01:30, 2002-12-14]
+"""
+
+class PythonLoader(syck.Loader):
+
+    def construct(self, node):
+        return super(PythonLoader, self).construct(node)
+
+class IntLoader(syck.Loader):
+
+    def construct_int(self, node):
+        return 'int:'+node.value
+
+class TestNativeLoader(unittest.TestCase):
+
+    def testNativeTypes(self):
+        self.assertEqual(PythonLoader('').find_native_types(), None)
+        self.assert_('int' not in IntLoader('').find_native_types())
+        self.assert_('int_hex' in IntLoader('').find_native_types())
+        self.assertEqual(syck.Loader('').find_native_types(),
+                syck.Loader.native_types)
+
+    def testInstanceConstructors(self):
+        loader = syck.Loader('- 123\n- 0x10\n')
+        loader.construct_int = lambda node: 'int:'+node.value
+        self.assert_('int' not in loader.find_native_types())
+        self.assert_('int_hex' in loader.find_native_types())
+        self.assertEqual(loader.load(), ['int:123', 16])
+        self.assertEqual(syck.Loader('').find_native_types(),
+                syck.Loader.native_types)
+        loader = syck.Loader('- 123\n')
+        loader.construct = lambda node: 'node'
+        self.assertEqual(loader.find_native_types(), None)
+        self.assertEqual(loader.load(), 'node')
+
+    def testNativeLoader(self):
+        document = syck.load(NATIVE)
+        self.assertEqual(document, syck.load(NATIVE, Loader=PythonLoader))
+        self.assertEqual(document[3][3], -INF)
+        self.assertEqual(type(document[4][0]), str)
+        self.assertEqual(type(document[4][1]), unicode)
+        self.assert_(document[5] is document[6])
+        self.assertEqual(document[7], datetime.datetime(2002, 12, 14))
+        self.assertEqual(document[8],
+                [90, 685230, 16, 15, 9223372036854775808L, 90.5])
+        self.assertEqual(document[9][0],
+                datetime.datetime(2001, 12, 15, 2, 59, 43))
+        self.assertEqual(document[9][1],
+                datetime.datetime(2001, 12, 14, 20, 29, 43))
+        self.assert_(document[9][2] is document[7])
+
+    def testInternKeys(self):
+        records = syck.load('- {name: foo, id: 1}\n- {name: bar, id: 2}\n',
+                intern_keys=True, dedup_scalars=True)
+        self.assertEqual(records, [{'name': 'foo', 'id': 1},
+            {'name': 'bar', 'id': 2}])
+        for record in records:
+            for key in record:
+                self.assert_(key is intern(key))
+
+    def testConstructorCache(self):
+        self.assertEqual(syck.load('- 1\n- !int 2\n', Loader=PythonLoader),
+                [1, 2])
+        self.assertEqual(syck.load('- 1\n- !int 2\n', Loader=IntLoader),
+                ['int:1', 'int:2'])
+        self.assertEqual(syck.load('- 1\n- !int 2\n', Loader=PythonLoader),
+                [1, 2])
+        self.assert_('_constructors' in PythonLoader.__dict__)
+
+    def testInstanceConstructor(self):
+        loader = PythonLoader('- !foo bar\n')
+        loader.construct_private_foo = lambda node: 'foo:'+node.value
+        self.assertEqual(loader.load(), ['foo:bar'])
+        self.assertEqual(PythonLoader('- !foo bar\n').load(), ['bar'])
+        loader = PythonLoader('- !foo bar\n')
+        loader.construct_private_foo = lambda node: 'foo:'+node.value
+        self.assertEqual(loader.load(), ['foo:bar'])
+
+    def testOverriddenConstructor(self):
+        self.assertEqual(syck.load('- 1\n- 0x10\n', Loader=IntLoader),
+                ['int:1', 16])
+
+    def testParserLoadNative(self):
+        parser = syck.Parser('foo: [1, 2.0, ~]\n')
+        self.assertEqual(parser.load_native(), {'foo': [1, 2.0, None]})
+        self.assertEqual(parser.load_native(), None)
+        self.assert_(parser.eof)
+        parser = syck.Parser('foo: [1, 2.0, ~]\n')
+        self.assertEqual(parser.load_native(['seq', 'map']),
+                {'foo': ['1', '2.0', '~']})
+
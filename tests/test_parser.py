@@ -3,7 +3,7 @@ import unittest
 
 import _syck
 
-import StringIO, gc, sys
+import StringIO, array, gc, os, sys, tempfile, weakref
 
 EXAMPLE = """
 -
@@ -198,6 +198,106 @@ class TestAttributes(unittest.TestCase):
         self.assertEqual(parser.parse(), None)
         self.assertEqual(parser.eof, True)
 
+class TestPauseGC(unittest.TestCase):
+
+    def testPauseGC(self):
+        parser = _syck.Parser(EXAMPLE, pause_gc=True)
+        self.assertEqual(parser.pause_gc, True)
+        self.assertEqual(parser.stats['documents'], 0)
+        node = parser.parse()
+        self.assert_(gc.isenabled())
+        self.assertEqual(parser.stats['documents'], 1)
+        self.assert_(parser.stats['nodes'] > 0)
+        self.assert_(parser.stats['collections_avoided'] >= 0)
+        parser.parse()
+        self.assert_(gc.isenabled())
+
+    def testDisabledGC(self):
+        gc.disable()
+        try:
+            _syck.Parser(EXAMPLE, pause_gc=True).parse()
+            self.assert_(not gc.isenabled())
+        finally:
+            gc.enable()
+
+    def testUntrackedScalars(self):
+        if not hasattr(gc, 'is_tracked'):
+            return
+        node = _syck.Parser(EXAMPLE).parse()
+        self.assert_(gc.is_tracked(node))
+        for item in node.value:
+            self.assert_(gc.is_tracked(item))
+            for key in item.value:
+                self.assert_(not gc.is_tracked(key))
+
+    def testScalarSubclassValue(self):
+        class String(str):
+            pass
+        class Marker:
+            pass
+        node = _syck.Parser("foo").parse()
+        value = String("bar")
+        value.node = node
+        value.marker = Marker()
+        marker = weakref.ref(value.marker)
+        node.value = value
+        if hasattr(gc, 'is_tracked'):
+            self.assert_(gc.is_tracked(node))
+        del node, value
+        gc.collect()
+        self.assertEqual(marker(), None)
+
+class TestSharedStrings(unittest.TestCase):
+
+    def testSharedTags(self):
+        node = _syck.Parser("- foo\n- bar\n- baz\n").parse()
+        first = node.value[0].tag
+        for item in node.value:
+            self.assert_(item.tag is first)
+
+    def testSharedAnchors(self):
+        node = _syck.Parser("- &a foo\n- &b bar\n- &a baz\n- &b quux\n",
+                implicit_typing=False).parse()
+        self.assertEqual(node.value[0].anchor, 'a')
+        self.assertEqual(node.value[1].anchor, 'b')
+        self.assert_(node.value[0].anchor is node.value[2].anchor)
+        self.assert_(node.value[1].anchor is node.value[3].anchor)
+
+    def testSharedEventTags(self):
+        tags = []
+        def callback(kind, id, tag, anchor, value):
+            tags.append(tag)
+        _syck.Parser("- foo\n- bar\n").parse_events(callback)
+        self.assert_(tags[0] is tags[1])
+
+class TestDedup(unittest.TestCase):
+
+    def testInternKeys(self):
+        parser = _syck.Parser("- {name: foo, id: 1}\n- {name: bar, id: 2}\n",
+                intern_keys=True)
+        self.assertEqual(parser.intern_keys, True)
+        node = parser.parse()
+        for item in node.value:
+            for key in item.value:
+                self.assert_(key.value is intern(key.value))
+
+    def testDedupScalars(self):
+        parser = _syck.Parser("- foo\n- bar\n- foo\n- bar\n",
+                dedup_scalars=True)
+        self.assertEqual(parser.dedup_scalars, True)
+        node = parser.parse()
+        values = [item.value for item in node.value]
+        self.assertEqual(values, ['foo', 'bar', 'foo', 'bar'])
+        self.assert_(values[0] is values[2])
+        self.assert_(values[1] is values[3])
+
+    def testLongScalars(self):
+        value = 'x'*1000
+        node = _syck.Parser("- %s\n- %s\n" % (value, value),
+                dedup_scalars=True).parse()
+        self.assertEqual(node.value[0].value, value)
+        self.assertEqual(node.value[1].value, value)
+
 class TestGarbage(unittest.TestCase):
 
     def testGarbage(self):
@@ -263,6 +363,64 @@ class TestValuesAndSources(unittest.TestCase, EqualStructure):
     def testFileValues3(self):
         self._testFileValues(COMPARE3)
 
+    def testBufferValues1(self):
+        self._testBufferValues(COMPARE1)
+
+    def testBufferValues2(self):
+        self._testBufferValues(COMPARE2)
+
+    def testBufferValues3(self):
+        self._testBufferValues(COMPARE3)
+
+    def testDescriptorValues(self):
+        for source, structure in [COMPARE1, COMPARE2, COMPARE3]:
+            file = os.tmpfile()
+            file.write(source)
+            file.flush()
+            file.seek(0)
+            os.lseek(file.fileno(), 0, 0)
+            parser = _syck.Parser(file.fileno(), bufsize=1024)
+            self.assertEqual(parser.bufsize, 1024)
+            self.assertEqualStructure(parser.parse(), structure)
+            file.seek(0)
+            parser = _syck.Parser(file, bufsize=1024)
+            self.assertEqualStructure(parser.parse(), structure)
+            file.close()
+
+    def testBufferSize(self):
+        source, structure = COMPARE2
+        file = os.tmpfile()
+        file.write(source)
+        file.seek(0)
+        parser = _syck.Parser(file, bufsize=64)
+        self.assertEqual(parser.bufsize, 64)
+        self.assertEqualStructure(parser.parse(), structure)
+        file.close()
+        parser = _syck.Parser(source, bufsize=64)
+        self.assertEqual(parser.bufsize, 4096)
+        self.assertEqualStructure(parser.parse(), structure)
+        parser = _syck.Parser(StringIO.StringIO(source), bufsize=64)
+        self.assertEqualStructure(parser.parse(), structure)
+
+    def testUniversalNewlines(self):
+        source, structure = COMPARE1
+        path = tempfile.mktemp()
+        try:
+            file = open(path, 'wb')
+            file.write(source.replace('\n', '\r'))
+            file.close()
+            file = open(path, 'rU')
+            self.assertEqualStructure(_syck.Parser(file).parse(), structure)
+            file.close()
+        finally:
+            os.remove(path)
+
+    def testClosedFile(self):
+        file = os.tmpfile()
+        file.close()
+        self.assertRaises(ValueError, lambda: _syck.Parser(file))
+        self.assertRaises(ValueError, lambda: _syck.Parser(-1))
+
     def testNonsense(self):
         parser = _syck.Parser(None)
         self.assertRaises(AttributeError, lambda: parser.parse())
@@ -304,6 +462,35 @@ class TestValuesAndSources(unittest.TestCase, EqualStructure):
         document = parser.parse()
         self.assertEqualStructure(document, structure)
 
+    def _testBufferValues(self, (source, structure)):
+        for buffer_source in [buffer(source), array.array('c', source)]:
+            parser = _syck.Parser(buffer_source)
+            document = parser.parse()
+            self.assertEqualStructure(document, structure)
+
+    def testResizedBuffer(self):
+        source, structure = COMPARE2
+        buffer_source = array.array('c')
+        parser = _syck.Parser(buffer_source)
+        buffer_source.fromstring(source)
+        self.assertEqualStructure(parser.parse(), structure)
+        buffer_source = array.array('c', source)
+        parser = _syck.Parser(buffer_source, bufsize=16)
+        def callback(kind, id, tag, anchor, value):
+            del buffer_source[:]
+        self.assertRaises(ValueError, lambda: parser.parse_events(callback))
+
+    def testHeldBuffer(self):
+        if sys.version_info < (2, 6):
+            return
+        source, structure = COMPARE1
+        buffer_source = bytearray(source)
+        parser = _syck.Parser(buffer_source)
+        self.assertRaises(BufferError, lambda: buffer_source.extend('\n'))
+        self.assertEqualStructure(parser.parse(), structure)
+        self.assertEqual(parser.parse(), None)
+        buffer_source.extend('\n')
+
 class TestDocuments(unittest.TestCase):
 
     def testDocuments0(self):
@@ -334,6 +521,43 @@ class TestDocuments(unittest.TestCase):
         self.assert_(parser.eof)
         self.assert_(parser.eof)
 
+class TestDecodeStr(unittest.TestCase):
+
+    def testDecodeStr(self):
+        for value in ['', 'a', 'an ascii string of some length']:
+            self.assert_(_syck.decode_str(value) is value)
+        for k in range(20):
+            value = 'x'*k+'\xe2\x98\xba'+'y'*k
+            self.assertEqual(_syck.decode_str(value), unicode(value, 'utf-8'))
+        self.assertRaises(UnicodeDecodeError, _syck.decode_str, 'abc\xff')
+        self.assertRaises(TypeError, _syck.decode_str, u'abc')
+
+class TestScanDocuments(unittest.TestCase):
+
+    def testScan(self):
+        for source, length in [(DOCUMENTS0, 0), (DOCUMENTS1, 1),
+                (DOCUMENTS2, 2), (DOCUMENTS3, 3)]:
+            self.assertEqual(len(_syck.scan_documents(source)), length)
+        self.assertEqual(_syck.scan_documents(
+            "# comment\n--- foo\n...\nbar\n%YAML:1.0\n---\n- baz"),
+            [0, 22, 26])
+
+    def testOffset(self):
+        offsets = _syck.scan_documents(DOCUMENTS3)
+        parser = _syck.Parser(DOCUMENTS3)
+        nodes = [parser.parse(), parser.parse(), parser.parse()]
+        for k in range(3):
+            parser = _syck.Parser(buffer(DOCUMENTS3), offset=offsets[k])
+            keys = [key.value for key in parser.parse().value]
+            keys.sort()
+            expected = [key.value for key in nodes[k].value]
+            expected.sort()
+            self.assertEqual(keys, expected)
+        self.assertRaises(ValueError,
+                lambda: _syck.Parser(DOCUMENTS3, offset=len(DOCUMENTS3)+1))
+        self.assertRaises(ValueError,
+                lambda: _syck.Parser(StringIO.StringIO(DOCUMENTS3), offset=1))
+
 class TestImplicitTyping(unittest.TestCase):
 
     def testImplicitAndExpansionTyping(self):
@@ -378,6 +602,126 @@ class TestParsingAliases(unittest.TestCase):
         node = parser.parse()
         self.assert_(node.value[0] is node.value[1])
 
+class TestDeferred(unittest.TestCase, EqualStructure):
+
+    def testAttribute(self):
+        self.assertEqual(_syck.Parser(EXAMPLE).deferred, False)
+        self.assertEqual(_syck.Parser(EXAMPLE, deferred=True).deferred, True)
+
+    def testValues(self):
+        for source, structure in [COMPARE1, COMPARE2, COMPARE3]:
+            parser = _syck.Parser(source, deferred=True)
+            self.assertEqualStructure(parser.parse(), structure)
+            parser = _syck.Parser(StringIO.StringIO(source), deferred=True)
+            self.assertEqualStructure(parser.parse(), structure)
+
+    def testDocuments(self):
+        parser = _syck.Parser(DOCUMENTS3, deferred=True)
+        length = 0
+        while parser.parse() is not None:
+            length += 1
+        self.assertEqual(length, 3)
+        self.assert_(parser.eof)
+
+    def testAliases(self):
+        parser = _syck.Parser(ALIASES, deferred=True)
+        node = parser.parse()
+        self.assert_(node.value[0] is node.value[1])
+
+    def testErrorLocation(self):
+        source, line, column = INVALID
+        parser = _syck.Parser(source, deferred=True)
+        try:
+            parser.parse()
+            raise Exception
+        except _syck.error, e:
+            self.assertEqual(e.args[1], line)
+            self.assertEqual(e.args[2], column)
+
+    def testRecursive(self):
+        parser = _syck.Parser(RECURSIVE, deferred=True)
+        self.assertRaises(TypeError, lambda: parser.parse())
+
+    def testLoadNative(self):
+        parser = _syck.Parser(EXAMPLE, deferred=True)
+        self.assertEqual(parser.load_native(),
+                _syck.Parser(EXAMPLE).load_native())
+
+SELECT = """
+services:
+  web:
+    endpoints: [/, /login]
+    image: nginx
+  db:
+    endpoints: [/sql]
+    image: postgres
+version: 2
+"""
+
+class TestSelect(unittest.TestCase, EqualStructure):
+
+    def testSelect(self):
+        parser = _syck.Parser(SELECT, select='services.*.endpoints')
+        self.assertEqual(parser.deferred, True)
+        self.assertEqualStructure(parser.parse(), {'services': {
+            'web': {'endpoints': ['/', '/login']},
+            'db': {'endpoints': ['/sql']}}})
+
+    def testSelectPaths(self):
+        parser = _syck.Parser(SELECT, select=['version', 'services.db.image'])
+        self.assertEqualStructure(parser.parse(), {'version': '2',
+            'services': {'db': {'image': 'postgres'}}})
+
+    def testSelectIndex(self):
+        parser = _syck.Parser("- [a, b]\n- [c, d]\n", select='*.1')
+        self.assertEqualStructure(parser.parse(), [['b'], ['d']])
+
+    def testSelectNothing(self):
+        parser = _syck.Parser(SELECT, select='nothing')
+        self.assertEqualStructure(parser.parse(), {})
+        self.assertRaises(TypeError, lambda: _syck.Parser(SELECT, select=[1]))
+
+    def testSelectThroughScalar(self):
+        parser = _syck.Parser("a: x\nb: {c: y}\n", select=['a.b', 'b.c'])
+        self.assertEqualStructure(parser.parse(), {'b': {'c': 'y'}})
+        parser = _syck.Parser("- x\n- [y]\n", select='*.0')
+        self.assertEqualStructure(parser.parse(), [['y']])
+
+    def testSelectEvents(self):
+        parser = _syck.Parser(SELECT, select='version')
+        self.assertRaises(ValueError,
+                lambda: parser.parse_events(lambda *args: None))
+
+class TestEvents(unittest.TestCase):
+
+    def testEvents(self):
+        events = []
+        def callback(kind, id, tag, anchor, value):
+            events.append((kind, id, anchor, value))
+        parser = _syck.Parser(ALIASES)
+        self.assertEqual(parser.parse_events(callback), 2)
+        self.assertEqual(events, [('scalar', 1, 'alias', 'foo'),
+            ('seq', 2, None, (1, 1))])
+        self.assertEqual(parser.parse_events(callback), None)
+        self.assert_(parser.eof)
+
+    def testMapping(self):
+        events = []
+        def callback(kind, id, tag, anchor, value):
+            events.append((kind, id, value))
+        parser = _syck.Parser("foo: bar")
+        self.assertEqual(parser.parse_events(callback), 3)
+        self.assertEqual(events, [('scalar', 1, 'foo'), ('scalar', 2, 'bar'),
+            ('map', 3, ((1, 2),))])
+
+    def testStop(self):
+        class Stop(Exception):
+            pass
+        def callback(kind, id, tag, anchor, value):
+            raise Stop
+        parser = _syck.Parser(EXAMPLE)
+        self.assertRaises(Stop, lambda: parser.parse_events(callback))
+
 class TestLeaks(unittest.TestCase):
 
     def testLeaks(self):